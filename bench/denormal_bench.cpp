@@ -0,0 +1,168 @@
+// Benchmark: cost of subnormal floats on a decaying signal, with and
+// without rt::DenormalGuard.
+//
+// A bank of two-pole resonators is struck once and left to ring out. Its
+// tail decays into the subnormal range within a fraction of a second and,
+// without flush-to-zero, rounding keeps it there indefinitely, so every
+// block after that runs on microcode assists. The benchmark times the
+// attack and the tail separately in both modes.
+//
+// Usage: DearJackDenormalBench [resonators] [seconds]
+
+#include "dsp.h"
+#include "rt.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+namespace {
+
+constexpr double SAMPLE_RATE = 48000.0;
+constexpr jack_nframes_t BLOCK_SIZE = 256;
+// Seconds timed as the attack, before the tail goes subnormal
+constexpr double ATTACK_SECONDS = 0.05;
+
+// Resonators with a 20 ms decay time constant, struck by note_on
+class ResonatorBank : public DSP {
+public:
+  explicit ResonatorBank(size_t count) : resonators(count) {}
+
+  void prepare(double sample_rate, jack_nframes_t) override {
+    const double radius = std::exp(-1.0 / (0.02 * sample_rate));
+    for (size_t i = 0; i < resonators.size(); ++i) {
+      const double hz = 110.0 * std::pow(1.02, static_cast<double>(i));
+      Resonator &r = resonators[i];
+      r.a1 = static_cast<float>(2.0 * radius *
+                                std::cos(TWO_PI * hz / sample_rate));
+      r.a2 = static_cast<float>(-radius * radius);
+    }
+  }
+
+  void note_on(int, float velocity) override {
+    for (Resonator &r : resonators) {
+      r.y1 += velocity;
+    }
+  }
+
+  void process_audio(jack_nframes_t nframes, float **, float **outputs,
+                     double) override {
+    float *out = outputs[0];
+    std::fill(out, out + nframes, 0.0f);
+    for (Resonator &r : resonators) {
+      float y1 = r.y1;
+      float y2 = r.y2;
+      for (jack_nframes_t i = 0; i < nframes; ++i) {
+        const float y = r.a1 * y1 + r.a2 * y2;
+        y2 = y1;
+        y1 = y;
+        out[i] += y;
+      }
+      r.y1 = y1;
+      r.y2 = y2;
+    }
+  }
+
+  int get_num_inputs() const override { return 0; }
+  int get_num_outputs() const override { return 1; }
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    static const std::vector<ParameterDescriptor> descriptors;
+    return descriptors;
+  }
+  void set_parameter(ParameterId, const ParameterValue &) override {}
+  ParameterValue get_parameter(ParameterId) const override { return 0.0f; }
+
+  // Resonators whose state is subnormal
+  size_t count_subnormal() const {
+    size_t count = 0;
+    for (const Resonator &r : resonators) {
+      count += std::fpclassify(r.y1) == FP_SUBNORMAL;
+    }
+    return count;
+  }
+
+private:
+  struct Resonator {
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+    float y1 = 0.0f;
+    float y2 = 0.0f;
+  };
+
+  std::vector<Resonator> resonators;
+};
+
+struct Timing {
+  double attack_ns = 0.0; // Per sample
+  double tail_ns = 0.0;   // Per sample
+  size_t subnormal = 0;   // Resonators subnormal at the end
+};
+
+Timing run(size_t resonators, double seconds, bool flush) {
+  std::optional<rt::DenormalGuard> guard;
+  if (flush) {
+    guard.emplace();
+  }
+  ResonatorBank bank(resonators);
+  bank.prepare(SAMPLE_RATE, BLOCK_SIZE);
+  bank.note_on(60, 1.0f);
+
+  std::vector<float> buffer(BLOCK_SIZE);
+  float *outputs[] = {buffer.data()};
+  const size_t attack_frames =
+      static_cast<size_t>(ATTACK_SECONDS * SAMPLE_RATE);
+  const size_t total_frames = static_cast<size_t>(seconds * SAMPLE_RATE);
+  // The tail is timed over the last half, well past the decay into the
+  // subnormal range
+  const size_t tail_start = total_frames / 2;
+  std::chrono::duration<double, std::nano> attack{0};
+  std::chrono::duration<double, std::nano> tail{0};
+  size_t tail_frames = 0;
+  volatile float sink = 0.0f;
+  for (size_t done = 0; done < total_frames; done += BLOCK_SIZE) {
+    const auto start = std::chrono::steady_clock::now();
+    bank.process_audio(BLOCK_SIZE, nullptr, outputs, SAMPLE_RATE);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    sink = sink + buffer[BLOCK_SIZE / 2];
+    if (done < attack_frames) {
+      attack += elapsed;
+    } else if (done >= tail_start) {
+      tail += elapsed;
+      tail_frames += BLOCK_SIZE;
+    }
+  }
+  return {attack.count() / static_cast<double>(attack_frames),
+          tail.count() / static_cast<double>(std::max<size_t>(tail_frames, 1)),
+          bank.count_subnormal()};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const size_t resonators =
+      argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 64;
+  const double seconds = argc > 2 ? std::atof(argv[2]) : 4.0;
+  if (resonators == 0 || seconds <= 2 * ATTACK_SECONDS) {
+    std::fprintf(stderr, "Usage: %s [resonators] [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  std::printf("%zu resonators, block %u at %.0f Hz, %.1f s\n", resonators,
+              BLOCK_SIZE, SAMPLE_RATE, seconds);
+  const Timing plain = run(resonators, seconds, false);
+  const Timing flushed = run(resonators, seconds, true);
+  std::printf("ns per sample %12s %12s %12s\n", "attack", "tail",
+              "subnormal");
+  std::printf("%-13s %12.2f %12.2f %12zu\n", "default", plain.attack_ns,
+              plain.tail_ns, plain.subnormal);
+  std::printf("%-13s %12.2f %12.2f %12zu\n", "FTZ/DAZ", flushed.attack_ns,
+              flushed.tail_ns, flushed.subnormal);
+  std::printf("tail slowdown without FTZ/DAZ: %.1fx\n",
+              plain.tail_ns / flushed.tail_ns);
+  return 0;
+}
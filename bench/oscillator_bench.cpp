@@ -0,0 +1,264 @@
+// Microbenchmark: templated BasicOscillator against the original per-sample
+// virtual generate_wave path, and the structure-of-arrays OscillatorBank
+// against one oscillator object per voice, and the long-run phase drift of
+// the fixed-point and float phase accumulators.
+//
+// Usage: DearJackOscillatorBench [block_size] [seconds] [drift_hours]
+//
+// The drift run is also a check, registered with CTest over a simulated
+// multi-hour run: it exits non-zero unless FixedPointPhase matches
+// n * increment mod 2^32 exactly and both accumulators' pitch errors stay
+// within the bounds below.
+
+#include "oscillator.h"
+#include "oscillator_bank.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr double SAMPLE_RATE = 48000.0;
+
+// Worst pitch error of FixedPointPhase: its increment is rounded to the
+// nearest 2^-32 of a cycle, so it is off by at most half of that per sample
+constexpr double MAX_FIXED_PITCH_ERROR_HZ = 0.5 * 0x1p-32 * SAMPLE_RATE;
+// FloatPhase accumulates rounding error instead; measured at 7.5e-5 cents
+// over 3 hours at DEFAULT_FREQUENCY, bounded with some margin
+constexpr double MAX_FLOAT_PITCH_ERROR_CENTS = 1e-3;
+
+// The oscillator as it was before the block renderer: phase in radians and
+// one virtual call per sample
+class VirtualOscillator {
+public:
+  virtual ~VirtualOscillator() = default;
+
+  void process_audio(jack_nframes_t nframes, float *out, double sample_rate) {
+    double phase_increment = TWO_PI * DEFAULT_FREQUENCY / sample_rate;
+    double local_phase = phase;
+    for (jack_nframes_t i = 0; i < nframes; ++i) {
+      out[i] = DEFAULT_AMPLITUDE * generate_wave(local_phase);
+      local_phase += phase_increment;
+      if (local_phase >= TWO_PI) {
+        local_phase -= TWO_PI;
+      }
+    }
+    phase = local_phase;
+  }
+
+protected:
+  virtual float generate_wave(double phase) const = 0;
+
+private:
+  double phase = 0.0;
+};
+
+class VirtualSin : public VirtualOscillator {
+protected:
+  float generate_wave(double phase) const override { return std::sin(phase); }
+};
+
+class VirtualSquare : public VirtualOscillator {
+protected:
+  float generate_wave(double phase) const override {
+    return (std::sin(phase) > 0) ? 1.0f : -1.0f;
+  }
+};
+
+class VirtualSaw : public VirtualOscillator {
+protected:
+  float generate_wave(double phase) const override {
+    return 2.0f * (phase / TWO_PI - std::floor(phase / TWO_PI + 0.5));
+  }
+};
+
+// Runs render(out) until `frames` samples are produced and returns ns/sample
+template <typename Render>
+double time_render(jack_nframes_t block_size, size_t frames, Render render) {
+  std::vector<float> buffer(block_size);
+  volatile float sink = 0.0f;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t done = 0; done < frames; done += block_size) {
+    render(buffer.data());
+    sink = sink + buffer[block_size / 2];
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(frames);
+}
+
+void run(const char *name, VirtualOscillator &legacy, DSP &templated,
+         jack_nframes_t block_size, size_t frames) {
+  const double legacy_ns = time_render(block_size, frames, [&](float *out) {
+    legacy.process_audio(block_size, out, SAMPLE_RATE);
+  });
+  const double templated_ns = time_render(block_size, frames, [&](float *out) {
+    float *outputs[] = {out};
+    templated.process_audio(block_size, nullptr, outputs, SAMPLE_RATE);
+  });
+
+  // Voices one core can sustain in real time at this sample rate
+  const double ns_per_second = 1e9 / SAMPLE_RATE;
+  std::printf("%-12s virtual %7.2f ns/sample (%6.0f voices)   "
+              "template %7.2f ns/sample (%6.0f voices)   %5.1fx\n",
+              name, legacy_ns, ns_per_second / legacy_ns, templated_ns,
+              ns_per_second / templated_ns, legacy_ns / templated_ns);
+}
+
+// Sustained voices through one DSP per voice, summed as PolyphonicDSP's
+// serial path does, against the same voices held in an OscillatorBank
+template <typename Waveform>
+void run_bank(const char *name, size_t num_voices, jack_nframes_t block_size,
+              size_t frames) {
+  std::vector<std::unique_ptr<DSP>> voices;
+  for (size_t v = 0; v < num_voices; ++v) {
+    voices.push_back(std::make_unique<BasicOscillator<Waveform>>());
+    voices.back()->set_parameter(Oscillator::FREQUENCY,
+                                 note_to_frequency(36 + static_cast<int>(v)));
+  }
+  std::vector<float> scratch(block_size);
+  const double objects_ns = time_render(block_size, frames, [&](float *out) {
+    float *outputs[] = {scratch.data()};
+    std::fill_n(out, block_size, 0.0f);
+    for (auto &voice : voices) {
+      voice->process_audio(block_size, nullptr, outputs, SAMPLE_RATE);
+      simd::add_to(out, scratch.data(), block_size);
+    }
+  });
+
+  OscillatorBank<Waveform> bank;
+  bank.prepare(SAMPLE_RATE, block_size);
+  for (size_t v = 0; v < num_voices; ++v) {
+    bank.note_on(36 + static_cast<int>(v), 1.0f);
+  }
+  const double bank_ns = time_render(block_size, frames, [&](float *out) {
+    float *outputs[] = {out};
+    bank.process_audio(block_size, nullptr, outputs, SAMPLE_RATE);
+  });
+
+  const double ns_per_second = 1e9 / SAMPLE_RATE;
+  const double count = static_cast<double>(num_voices);
+  std::printf("%-12s %zu voices: objects %7.2f ns/voice-sample (%6.0f "
+              "voices)   bank %7.2f ns/voice-sample (%6.0f voices)   %5.1fx\n",
+              name, num_voices, objects_ns / count,
+              ns_per_second * count / objects_ns, bank_ns / count,
+              ns_per_second * count / bank_ns, objects_ns / bank_ns);
+}
+
+// Distance between two phases in cycles, across the wrap
+double phase_distance(double a, double b) {
+  const double d = std::fabs(a - b);
+  return std::min(d, 1.0 - d);
+}
+
+// Renders `hours` of a constant DEFAULT_FREQUENCY tone and compares the
+// oscillator's phase with the exact one, every block. FixedPointPhase is
+// also checked bit for bit against n * increment mod 2^32, which it must
+// match however long it runs; its only error against the ideal tone is the
+// constant pitch offset of the rounded increment. Returns false if a check
+// fails.
+template <typename Phase>
+bool run_drift(const char *name, double hours, jack_nframes_t block_size) {
+  BasicOscillator<SineWaveform, Phase> oscillator;
+  std::vector<float> buffer(block_size);
+  float *outputs[] = {buffer.data()};
+  const long double increment =
+      static_cast<long double>(DEFAULT_FREQUENCY) / SAMPLE_RATE;
+  const uint64_t fixed_increment = static_cast<uint64_t>(
+      FixedPointPhase::to_increment(DEFAULT_FREQUENCY / SAMPLE_RATE));
+  const uint64_t frames = static_cast<uint64_t>(hours * 3600.0 * SAMPLE_RATE);
+
+  double max_error = 0.0;
+  bool exact = true;
+  volatile float sink = 0.0f;
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t done = 0;
+  while (done < frames) {
+    oscillator.process_audio(block_size, nullptr, outputs, SAMPLE_RATE);
+    sink = sink + buffer[block_size / 2];
+    done += block_size;
+    const long double cycles = done * increment;
+    const double ideal = static_cast<double>(cycles - std::floor(cycles));
+    max_error =
+        std::max(max_error, phase_distance(oscillator.get_phase(), ideal));
+    exact = exact && oscillator.get_phase() ==
+                         ((done * fixed_increment) & 0xffffffffu) * 0x1p-32;
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  // Pitch error over the run, from the phase error at its end
+  const long double cycles = done * increment;
+  const double end_error = oscillator.get_phase() -
+                           static_cast<double>(cycles - std::floor(cycles));
+  const double wrapped = end_error - std::round(end_error);
+  const double hz = wrapped * SAMPLE_RATE / static_cast<double>(done);
+  const double cents = 1200.0 * std::log2(1.0 + hz / DEFAULT_FREQUENCY);
+  constexpr bool fixed_point = std::is_same_v<Phase, FixedPointPhase>;
+  const bool passed = fixed_point
+                          ? exact && std::fabs(hz) <= MAX_FIXED_PITCH_ERROR_HZ
+                          : std::fabs(cents) <= MAX_FLOAT_PITCH_ERROR_CENTS;
+  std::printf("%-16s %.1f h: max phase error %.3g cycles, pitch error %+.3g "
+              "Hz (%+.3g cents), %5.2f ns/sample%s%s\n",
+              name, hours, max_error, hz, cents,
+              elapsed.count() / static_cast<double>(done),
+              fixed_point ? (exact ? ", exact" : ", NOT EXACT") : "",
+              passed ? "" : ", FAILED");
+  return passed;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const jack_nframes_t block_size =
+      argc > 1 ? static_cast<jack_nframes_t>(std::atoi(argv[1])) : 64;
+  const double seconds = argc > 2 ? std::atof(argv[2]) : 10.0;
+  const double drift_hours = argc > 3 ? std::atof(argv[3]) : 1.0;
+  if (block_size == 0 || seconds <= 0.0 || drift_hours < 0.0) {
+    std::fprintf(stderr, "Usage: %s [block_size] [seconds] [drift_hours]\n",
+                 argv[0]);
+    return 1;
+  }
+  const size_t frames = static_cast<size_t>(seconds * SAMPLE_RATE);
+
+  std::printf("block size %u, %.1f s of audio at %.0f Hz, %zu-wide SIMD\n",
+              block_size, seconds, SAMPLE_RATE, simd::vfloat::width);
+
+  VirtualSin legacy_sin;
+  VirtualSquare legacy_square;
+  VirtualSaw legacy_saw;
+  SinOsc sin_osc;
+  SquareWave square_wave;
+  SawWave saw_wave;
+  run("SinOsc", legacy_sin, sin_osc, block_size, frames);
+  run("SquareWave", legacy_square, square_wave, block_size, frames);
+  run("SawWave", legacy_saw, saw_wave, block_size, frames);
+
+  // Band-limited variants, against the naive virtual waveforms they replace
+  BandLimitedSquareWave square_wave_bl;
+  BandLimitedSawWave saw_wave_bl;
+  run("SquareWaveBL", legacy_square, square_wave_bl, block_size, frames);
+  run("SawWaveBL", legacy_saw, saw_wave_bl, block_size, frames);
+
+  // Polyphony: per-voice objects against the voice bank. Fewer frames, as
+  // each one renders every voice.
+  const size_t bank_frames = frames / 16;
+  run_bank<SineWaveform>("SinBank", 64, block_size, bank_frames);
+  run_bank<SquareWaveform>("SquareBank", 64, block_size, bank_frames);
+  run_bank<SawWaveform>("SawBank", 64, block_size, bank_frames);
+
+  // Phase accumulators over a long run; 0 hours skips it
+  bool passed = true;
+  if (drift_hours > 0.0) {
+    passed &=
+        run_drift<FixedPointPhase>("FixedPointPhase", drift_hours, block_size);
+    passed &= run_drift<FloatPhase>("FloatPhase", drift_hours, block_size);
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+// Offline render harness: renders any registered DSP type without JACK or a
+// window and reports its throughput, optionally writing the audio to a WAV
+// file for correctness diffs between builds.
+//
+// Usage: DearJackRenderBench <dsp_type> [--voices N] [--notes N]
+//            [--block N] [--rate HZ] [--seconds S] [--threads N]
+//            [--oversample N] [--plugins DIR] [--wav PATH] [--raw]
+//
+// Types are hosted as the GUI hosts them: polyphonic types as they are, the
+// others in a PolyphonicDSP of --voices voices. --raw renders the factory
+// DSP directly instead. --notes notes (default: one per voice) are held for
+// the whole render. --threads starts that many ThreadManager workers; with
+// none, everything runs on one core. --oversample 2, 4 or 8 renders through
+// an OversampledDSP. --plugins loads the DSP plugins in DIR first, so
+// their types can be rendered too.
+
+#include "dsp_factory.h"
+#include "oversampled_dsp.h"
+#include "plugin_loader.h"
+#include "polyphonic_dsp.h"
+#include "rt.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string dsp_type;
+  int voices = 16;
+  int notes = -1; // One per voice
+  jack_nframes_t block_size = 256;
+  double sample_rate = 48000.0;
+  double seconds = 10.0;
+  unsigned threads = 0;
+  int oversampling = 1;
+  std::string plugin_directory;
+  std::string wav_path;
+  bool raw = false;
+};
+
+void print_usage(const char *program) {
+  std::fprintf(stderr,
+               "Usage: %s <dsp_type> [--voices N] [--notes N] [--block N] "
+               "[--rate HZ] [--seconds S] [--threads N] [--oversample N] "
+               "[--plugins DIR] [--wav PATH] [--raw]\n",
+               program);
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  if (argc < 2) {
+    return false;
+  }
+  options.dsp_type = argv[1];
+  for (int i = 2; i < argc; ++i) {
+    const std::string flag = argv[i];
+    if (flag == "--raw") {
+      options.raw = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (flag == "--voices") {
+      options.voices = std::atoi(value);
+    } else if (flag == "--notes") {
+      options.notes = std::atoi(value);
+    } else if (flag == "--block") {
+      options.block_size = static_cast<jack_nframes_t>(std::atoi(value));
+    } else if (flag == "--rate") {
+      options.sample_rate = std::atof(value);
+    } else if (flag == "--seconds") {
+      options.seconds = std::atof(value);
+    } else if (flag == "--threads") {
+      options.threads = static_cast<unsigned>(std::atoi(value));
+    } else if (flag == "--oversample") {
+      options.oversampling = std::atoi(value);
+    } else if (flag == "--plugins") {
+      options.plugin_directory = value;
+    } else if (flag == "--wav") {
+      options.wav_path = value;
+    } else {
+      return false;
+    }
+  }
+  if (options.notes < 0) {
+    options.notes = options.voices;
+  }
+  return options.voices > 0 && options.block_size > 0 &&
+         options.sample_rate > 0.0 && options.seconds > 0.0;
+}
+
+// 32-bit float WAV of a known length, written block by block
+class WavWriter {
+public:
+  WavWriter(const std::string &path, int channels, double sample_rate,
+            size_t frames)
+      : file(std::fopen(path.c_str(), "wb")) {
+    if (!file) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    const uint32_t data_bytes =
+        static_cast<uint32_t>(frames * channels * sizeof(float));
+    const uint16_t block_align = static_cast<uint16_t>(channels * 4);
+    const uint32_t rate = static_cast<uint32_t>(sample_rate);
+    std::fwrite("RIFF", 1, 4, file);
+    write_u32(36 + data_bytes);
+    std::fwrite("WAVEfmt ", 1, 8, file);
+    write_u32(16);
+    write_u16(3); // IEEE float
+    write_u16(static_cast<uint16_t>(channels));
+    write_u32(rate);
+    write_u32(rate * block_align);
+    write_u16(block_align);
+    write_u16(32);
+    std::fwrite("data", 1, 4, file);
+    write_u32(data_bytes);
+  }
+  ~WavWriter() { std::fclose(file); }
+
+  WavWriter(const WavWriter &) = delete;
+  WavWriter &operator=(const WavWriter &) = delete;
+
+  void write(float *const *channels, int num_channels, jack_nframes_t frames) {
+    interleaved.resize(static_cast<size_t>(frames) * num_channels);
+    for (jack_nframes_t i = 0; i < frames; ++i) {
+      for (int ch = 0; ch < num_channels; ++ch) {
+        interleaved[i * num_channels + ch] = channels[ch][i];
+      }
+    }
+    std::fwrite(interleaved.data(), sizeof(float), interleaved.size(), file);
+  }
+
+private:
+  void write_u16(uint16_t value) { std::fwrite(&value, 2, 1, file); }
+  void write_u32(uint32_t value) { std::fwrite(&value, 4, 1, file); }
+
+  std::FILE *file;
+  std::vector<float> interleaved;
+};
+
+int run(const Options &options) {
+  // Render with the floating-point mode the process callback uses
+  rt::DenormalGuard denormals;
+  std::unique_ptr<DSP> dsp;
+  if (!options.raw) {
+    dsp = create_instance_dsp(options.dsp_type, options.voices,
+                              options.oversampling);
+  } else if (options.oversampling != 1) {
+    dsp = std::make_unique<OversampledDSP>(
+        DSPFactory::instance().create_dsp(options.dsp_type),
+        options.oversampling);
+  } else {
+    dsp = DSPFactory::instance().create_dsp(options.dsp_type);
+  }
+  dsp->prepare(options.sample_rate, options.block_size);
+  for (int n = 0; n < options.notes; ++n) {
+    dsp->note_on((24 + n) % 128, 1.0f);
+  }
+
+  const int num_inputs = dsp->get_num_inputs();
+  const int num_outputs = dsp->get_num_outputs();
+  // Silent inputs; outputs are rendered in place block after block
+  std::vector<float> memory(
+      static_cast<size_t>(num_inputs + num_outputs) * options.block_size, 0.0f);
+  std::vector<float *> inputs(num_inputs);
+  std::vector<float *> outputs(num_outputs);
+  for (int ch = 0; ch < num_inputs; ++ch) {
+    inputs[ch] = memory.data() + ch * options.block_size;
+  }
+  for (int ch = 0; ch < num_outputs; ++ch) {
+    outputs[ch] = memory.data() + (num_inputs + ch) * options.block_size;
+  }
+
+  const size_t total_frames =
+      static_cast<size_t>(options.seconds * options.sample_rate);
+  std::unique_ptr<WavWriter> wav;
+  if (!options.wav_path.empty()) {
+    wav = std::make_unique<WavWriter>(options.wav_path, num_outputs,
+                                      options.sample_rate, total_frames);
+  }
+
+  std::chrono::nanoseconds elapsed{0};
+  for (size_t done = 0; done < total_frames;) {
+    const jack_nframes_t frames = static_cast<jack_nframes_t>(
+        std::min<size_t>(options.block_size, total_frames - done));
+    const auto start = std::chrono::steady_clock::now();
+    dsp->process_audio(frames, inputs.data(), outputs.data(),
+                       options.sample_rate);
+    elapsed += std::chrono::steady_clock::now() - start;
+    if (wav) {
+      wav->write(outputs.data(), num_outputs, frames);
+    }
+    done += frames;
+  }
+
+  // Voices is what was asked to sound; a PolyphonicDSP reports what did
+  int voices = options.notes;
+  DSP *inner = dsp.get();
+  if (auto *oversampled = dynamic_cast<OversampledDSP *>(inner)) {
+    inner = &oversampled->get_dsp();
+  }
+  if (auto *poly = dynamic_cast<PolyphonicDSP *>(inner)) {
+    voices = static_cast<int>(poly->get_num_active_voices());
+  }
+  const double ns_per_sample =
+      static_cast<double>(elapsed.count()) / static_cast<double>(total_frames);
+  const double realtime_factor = 1e9 / options.sample_rate / ns_per_sample;
+  const unsigned cores = ThreadManager::num_participants();
+  std::printf("%s: block %u at %.0f Hz, %.1f s, %u core(s)\n",
+              options.dsp_type.c_str(), options.block_size,
+              options.sample_rate, options.seconds, cores);
+  std::printf("  %.2f ns/sample, %.1fx real time\n", ns_per_sample,
+              realtime_factor);
+  if (options.oversampling != 1) {
+    std::printf("  oversampled %dx, %u frames latency\n", options.oversampling,
+                dsp->get_latency());
+  }
+  if (voices > 0) {
+    std::printf("  %d voices: %.3f ns/voice-sample, %.0f voices/core\n",
+                voices, ns_per_sample / voices,
+                voices * realtime_factor / cores);
+  }
+  if (wav) {
+    std::printf("  wrote %s\n", options.wav_path.c_str());
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  register_builtin_dsps();
+  std::unique_ptr<PluginLoader> plugins;
+  if (!options.plugin_directory.empty()) {
+    plugins = std::make_unique<PluginLoader>(options.plugin_directory);
+    plugins->scan();
+  }
+  if (options.threads > 0) {
+    ThreadManager::init(options.threads);
+  }
+  int status = 0;
+  try {
+    status = run(options);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    status = 1;
+  }
+  if (options.threads > 0) {
+    ThreadManager::shutdown();
+  }
+  return status;
+}
@@ -0,0 +1,94 @@
+/*
+ * Example DearJack plugin: a naive pulse oscillator with variable width.
+ *
+ * Build it as a shared object next to the binary's plugins directory (the
+ * DearJackExamplePlugin target does this) and it shows up as the
+ * "ExamplePulse" DSP type. Not being polyphonic, it is hosted one instance
+ * per voice, and the host sets "frequency" to each note's pitch.
+ */
+#include "dearjack_plugin.h"
+
+#include <stdlib.h>
+
+enum { FREQUENCY, AMPLITUDE, WIDTH, NUM_PARAMETERS };
+
+typedef struct Pulse {
+  double sample_rate;
+  double phase; /* In cycles, [0, 1) */
+  float frequency;
+  float amplitude;
+  float width;
+} Pulse;
+
+static void *pulse_create(void) {
+  Pulse *pulse = calloc(1, sizeof(Pulse));
+  if (pulse) {
+    pulse->sample_rate = 48000.0;
+  }
+  return pulse;
+}
+
+static void pulse_destroy(void *dsp) { free(dsp); }
+
+static void pulse_prepare(void *dsp, double sample_rate, uint32_t max_block) {
+  (void)max_block;
+  ((Pulse *)dsp)->sample_rate = sample_rate;
+}
+
+static void pulse_process(void *dsp, uint32_t nframes,
+                          const float *const *inputs, float *const *outputs) {
+  Pulse *pulse = dsp;
+  const double increment = pulse->frequency / pulse->sample_rate;
+  float *out = outputs[0];
+  (void)inputs;
+  for (uint32_t i = 0; i < nframes; ++i) {
+    out[i] = pulse->phase < pulse->width ? pulse->amplitude : -pulse->amplitude;
+    pulse->phase += increment;
+    if (pulse->phase >= 1.0) {
+      pulse->phase -= 1.0;
+    }
+  }
+}
+
+static void pulse_set_parameter(void *dsp, uint32_t id, float value) {
+  Pulse *pulse = dsp;
+  switch (id) {
+  case FREQUENCY:
+    pulse->frequency = value;
+    break;
+  case AMPLITUDE:
+    pulse->amplitude = value;
+    break;
+  case WIDTH:
+    pulse->width = value;
+    break;
+  }
+}
+
+static const DearJackParameter parameters[NUM_PARAMETERS] = {
+    {"frequency", DEARJACK_PARAMETER_FLOAT, 20.0f, 20000.0f, 440.0f},
+    {"amplitude", DEARJACK_PARAMETER_FLOAT, 0.0f, 1.0f, 0.5f},
+    {"width", DEARJACK_PARAMETER_FLOAT, 0.05f, 0.95f, 0.5f},
+};
+
+static const DearJackDSPType types[] = {{
+    .name = "ExamplePulse",
+    .num_inputs = 0,
+    .num_outputs = 1,
+    .flags = 0,
+    .latency = 0,
+    .num_parameters = NUM_PARAMETERS,
+    .parameters = parameters,
+    .create = pulse_create,
+    .destroy = pulse_destroy,
+    .prepare = pulse_prepare,
+    .process = pulse_process,
+    .set_parameter = pulse_set_parameter,
+}};
+
+static const DearJackPlugin plugin = {
+    DEARJACK_PLUGIN_ABI_VERSION, sizeof(types) / sizeof(types[0]), types};
+
+DEARJACK_EXPORT const DearJackPlugin *dearjack_plugin_entry(void) {
+  return &plugin;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "simd.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Wait-free mono sample ring from the audio thread to the GUI.
+//
+// The process callback mixes a period's signals into the ring, keeping every
+// decimation-th sample, and the GUI drains whatever has arrived once a
+// frame. A period is summed in place in the free part of the ring and
+// published once, so mixing several instances needs no scratch buffer. When
+// the GUI falls behind, new samples are dropped rather than overwriting ones
+// it may be reading.
+class AudioTap {
+public:
+  static constexpr size_t CAPACITY = size_t{1} << 15;
+
+  // Control side. Keep one sample in every `decimation`; takes effect at the
+  // next period.
+  void set_decimation(unsigned decimation) {
+    this->decimation.store(std::max(1u, decimation),
+                           std::memory_order_relaxed);
+  }
+  unsigned get_decimation() const {
+    return decimation.load(std::memory_order_relaxed);
+  }
+
+  // Producer side. Starts a period of nframes samples, all zero until
+  // mixed into with mix(); end_period() publishes it.
+  void begin_period(size_t nframes) {
+    step = decimation.load(std::memory_order_relaxed);
+    phase %= step;
+    first = (step - phase) % step;
+    const size_t kept = first < nframes ? (nframes - 1 - first) / step + 1 : 0;
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t free =
+        CAPACITY - (tail - head_.load(std::memory_order_acquire));
+    pending = std::min(kept, free);
+    if (pending < kept) {
+      dropped.fetch_add(kept - pending, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < pending; ++i) {
+      samples[(tail + i) & MASK] = 0.0f;
+    }
+    period_frames = nframes;
+  }
+
+  // Producer side. Adds a block of the current period.
+  void mix(const float *block) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < pending; ++i) {
+      samples[(tail + i) & MASK] += block[first + i * step];
+    }
+  }
+
+  // Producer side
+  void end_period() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + pending,
+                std::memory_order_release);
+    phase = static_cast<unsigned>((phase + period_frames) % step);
+  }
+
+  // Consumer side. Copies out up to max of the oldest samples and returns
+  // how many.
+  size_t read(float *out, size_t max) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t count =
+        std::min(max, tail_.load(std::memory_order_acquire) - head);
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = samples[(head + i) & MASK];
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Samples lost to a full ring
+  uint64_t get_dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr size_t MASK = CAPACITY - 1;
+
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  std::atomic<unsigned> decimation{1};
+  std::atomic<uint64_t> dropped{0};
+  // Producer: the period being mixed
+  unsigned step = 1;
+  unsigned phase = 0; // Position in the decimation cycle of the next frame
+  size_t first = 0;
+  size_t pending = 0;
+  size_t period_frames = 0;
+  alignas(64) std::array<float, CAPACITY> samples{};
+};
+
+// GUI side of an AudioTap: a scope of the latest samples and the level of
+// the samples that arrived at the last update, worked out in SIMD here
+// rather than on the audio thread.
+class TapMeter {
+public:
+  static constexpr size_t SCOPE_SAMPLES = 1024;
+
+  TapMeter() : scope(SCOPE_SAMPLES, 0.0f) {}
+
+  // Drains the tap and returns true if any samples arrived
+  bool update(AudioTap &tap) {
+    if (drained.empty()) {
+      drained.resize(AudioTap::CAPACITY);
+    }
+    const size_t count = tap.read(drained.data(), drained.size());
+    if (count == 0) {
+      return false;
+    }
+    const simd::BlockLevel level = simd::block_level(drained.data(), count);
+    peak = level.peak;
+    rms = std::sqrt(level.energy / static_cast<float>(count));
+
+    // Oldest first: shift the scope left by what arrived and append it
+    const size_t keep = SCOPE_SAMPLES - std::min(count, SCOPE_SAMPLES);
+    std::copy(scope.end() - keep, scope.end(), scope.begin());
+    std::copy(drained.begin() + (count - (SCOPE_SAMPLES - keep)),
+              drained.begin() + count, scope.begin() + keep);
+    return true;
+  }
+
+  const std::vector<float> &get_scope() const { return scope; }
+  float get_peak() const { return peak; }
+  float get_rms() const { return rms; }
+
+private:
+  std::vector<float> scope;
+  // Read buffer, sized at the first update
+  std::vector<float> drained;
+  float peak = 0.0f;
+  float rms = 0.0f;
+};
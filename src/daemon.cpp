@@ -0,0 +1,490 @@
+// Headless engine: hosts DSP instances in one JACK client and takes its
+// control from OSC over UDP instead of a window, for machines without a
+// GPU or display.
+//
+// Usage: DearJackDaemon [--bind ADDR] [--port N] [--name CLIENT]
+//            [--voices N] [--oversample N] [--plugins DIR]
+//            [--session PATH] [TYPE[:NAME]]...
+//
+// OSC is received on --bind, by default 127.0.0.1 so that only local
+// processes are heard. The protocol has no authentication, so bind another
+// address only on a trusted network.
+//
+// --session restores the instances, parameters and connections of a saved
+// session's client named CLIENT, or its first client. Each TYPE[:NAME]
+// starts a further instance. --voices and --oversample (1, 2, 4 or 8) are
+// the defaults for new instances. DSP plugins are loaded from --plugins,
+// by default $DEARJACK_PLUGIN_DIR or ./plugins, before anything starts,
+// and re-scanned on /dearjack/rescan or SIGHUP. The OSC address space,
+// where <instance> is an instance name:
+//
+//   /dearjack/add                      s:type [s:name] [i:voices
+//                                      [i:oversampling]]
+//   /dearjack/remove                   s:name
+//   /dearjack/rescan
+//   /dearjack/quit
+//   /dearjack/<instance>/note_on       i:note [f:velocity]
+//   /dearjack/<instance>/note_off      i:note
+//   /dearjack/<instance>/<parameter>   f, i or s value
+//   /dearjack/changes                  i:version
+//   /dearjack/save                     [s:path]
+//
+// /dearjack/save writes the --session file, or path, which must be
+// relative and stay inside the --session file's directory (the working
+// directory without --session).
+//
+// Everything received in one wakeup is one batch, and parameter updates in
+// a batch are coalesced: only the last value sent for each parameter of an
+// instance reaches its DSP's parameter queue. Each batch that changes
+// something advances the client's parameter version. /dearjack/changes
+// replies with a /dearjack/<instance>/<parameter> message for every value
+// changed after the given version, then /dearjack/version with the current
+// one, so a control host can stay in sync by polling with the last version
+// it saw (0 for everything).
+
+#include "dsp_factory.h"
+#include "jack_client.h"
+#include "osc.h"
+#include "parameter_store.h"
+#include "plugin_loader.h"
+#include "reclaimer.h"
+#include "rt_alloc_check.h"
+#include "session.h"
+#include "thread_manager.h"
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+
+constexpr const char *ADDRESS_PREFIX = "/dearjack/";
+// Longest wait for control messages before the housekeeping runs again
+constexpr int POLL_TIMEOUT_MS = 100;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+volatile std::sig_atomic_t rescan_requested = 0;
+
+void request_stop(int) { stop_requested = 1; }
+void request_rescan(int) { rescan_requested = 1; }
+
+struct Options {
+  std::string bind_address = "127.0.0.1";
+  uint16_t port = 9000;
+  std::string client_name = "DearJack";
+  int voices = 16;
+  int oversampling = 1;
+  std::string plugin_directory;
+  std::string session_path;
+  // Instances to start, as TYPE or TYPE:NAME
+  std::vector<std::string> instances;
+};
+
+void print_usage(const char *program) {
+  std::fprintf(stderr,
+               "Usage: %s [--bind ADDR] [--port N] [--name CLIENT] "
+               "[--voices N] [--oversample N] [--plugins DIR] "
+               "[--session PATH] [TYPE[:NAME]]...\n",
+               program);
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--", 0) != 0) {
+      options.instances.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--bind") {
+      options.bind_address = value;
+    } else if (arg == "--port") {
+      options.port = static_cast<uint16_t>(std::atoi(value));
+    } else if (arg == "--name") {
+      options.client_name = value;
+    } else if (arg == "--voices") {
+      options.voices = std::atoi(value);
+    } else if (arg == "--oversample") {
+      options.oversampling = std::atoi(value);
+    } else if (arg == "--plugins") {
+      options.plugin_directory = value;
+    } else if (arg == "--session") {
+      options.session_path = value;
+    } else {
+      return false;
+    }
+  }
+  return options.voices > 0 && options.oversampling > 0 &&
+         !options.client_name.empty();
+}
+
+// OSC argument as a value for the descriptor's type, if it converts
+std::optional<ParameterValue>
+to_parameter_value(const ParameterDescriptor &descriptor,
+                   const OscArgument &argument) {
+  const std::string *text = std::get_if<std::string>(&argument);
+  switch (descriptor.type) {
+  case ParameterType::Float:
+    if (text) {
+      return std::nullopt;
+    }
+    if (const int32_t *i = std::get_if<int32_t>(&argument)) {
+      return static_cast<float>(*i);
+    }
+    return std::get<float>(argument);
+  case ParameterType::Int:
+    if (text) {
+      return std::nullopt;
+    }
+    if (const float *f = std::get_if<float>(&argument)) {
+      return static_cast<int>(std::lround(*f));
+    }
+    return static_cast<int>(std::get<int32_t>(argument));
+  case ParameterType::String:
+    if (!text) {
+      return std::nullopt;
+    }
+    return *text;
+  }
+  return std::nullopt;
+}
+
+OscArgument to_osc_argument(const ParameterValue &value) {
+  if (const float *f = std::get_if<float>(&value)) {
+    return *f;
+  }
+  if (const int *i = std::get_if<int>(&value)) {
+    return static_cast<int32_t>(*i);
+  }
+  return std::get<std::string>(value);
+}
+
+// The control thread of the daemon: applies OSC messages to one JackClient
+class Daemon {
+public:
+  // Loads the plugins in plugin_directory before anything can use them.
+  // /dearjack/save writes session_path, or files in its directory.
+  Daemon(const std::string &client_name, std::string plugin_directory,
+         std::string session_path, int default_voices,
+         int default_oversampling)
+      : client(client_name.c_str()), plugins(std::move(plugin_directory)),
+        session_path(std::move(session_path)), default_voices(default_voices),
+        default_oversampling(default_oversampling) {
+    rescan();
+  }
+
+  // Adds an instance of type named name, or "<type><n>" if name is empty
+  void add(const std::string &type, std::string name, int voices,
+           int oversampling) {
+    if (voices < 1) {
+      throw std::invalid_argument("An instance needs at least one voice");
+    }
+    if (name.empty()) {
+      // Skip names a restored session already uses
+      do {
+        name = type + std::to_string(++instance_count);
+      } while (client.find_instance(name));
+    }
+    if (name.find('/') != std::string::npos || client.find_instance(name)) {
+      throw std::invalid_argument("Instance name " + name +
+                                  " is taken or invalid");
+    }
+    client.add_instance(name,
+                        create_instance_dsp(type, voices, oversampling),
+                        name + "_", {type, voices, oversampling});
+    std::cerr << "Added " << type << " instance " << name << std::endl;
+  }
+
+  // Restores the saved client named like ours, or the first one
+  void restore(const Session &session) {
+    if (session.clients.empty()) {
+      return;
+    }
+    const SessionClient *saved = &session.clients.front();
+    for (const SessionClient &candidate : session.clients) {
+      if (candidate.name == client.get_name()) {
+        saved = &candidate;
+      }
+    }
+    restore_instances(*saved, client);
+    restore_connections(session, client);
+  }
+
+  void handle(const OscMessage &message, OscServer &server) {
+    try {
+      dispatch(message, server);
+    } catch (const std::exception &e) {
+      std::cerr << message.address << ": " << e.what() << std::endl;
+    }
+  }
+
+  // Loads new and changed plugins and drops removed ones. Running instances
+  // keep the code they were created with.
+  void rescan() {
+    const PluginLoader::ScanResult result = plugins.scan();
+    std::cerr << "Plugins in " << plugins.get_directory() << ": "
+              << result.loaded << " loaded, " << result.removed
+              << " removed, " << result.failed << " failed" << std::endl;
+  }
+
+  // Hands the batch's coalesced parameter updates to the DSPs
+  void flush() { client.commit_parameters(); }
+
+  // Runs after every batch
+  void housekeeping() {
+    client.collect_garbage();
+    // Keep workers off the JACK thread's core and at its realtime priority,
+    // as the GUI does
+    ThreadManager::set_avoided_cpu(client.get_process_cpu());
+    const int priority = client.get_realtime_priority();
+    if (priority != worker_priority) {
+      worker_priority = priority;
+      ThreadManager::set_realtime_priority(priority);
+    }
+  }
+
+  bool quit_requested() const { return quit; }
+
+private:
+  void dispatch(const OscMessage &message, OscServer &server) {
+    const std::string &address = message.address;
+    const auto &args = message.arguments;
+    if (address.rfind(ADDRESS_PREFIX, 0) != 0) {
+      throw std::invalid_argument("Unknown address");
+    }
+    const std::string path = address.substr(std::strlen(ADDRESS_PREFIX));
+
+    if (path == "quit") {
+      quit = true;
+      return;
+    }
+    if (path == "rescan") {
+      rescan();
+      return;
+    }
+    if (path == "changes") {
+      if (args.size() != 1 || !std::holds_alternative<int32_t>(args[0])) {
+        throw std::invalid_argument("Expected a version");
+      }
+      reply_changes(static_cast<uint64_t>(std::get<int32_t>(args[0])),
+                    server);
+      return;
+    }
+    if (path == "save") {
+      if (args.size() > 1 ||
+          (args.size() == 1 && !std::holds_alternative<std::string>(args[0]))) {
+        throw std::invalid_argument("Expected a path");
+      }
+      const std::string target = save_path(
+          args.empty() ? std::string() : std::get<std::string>(args[0]));
+      // Staged updates of this batch are part of the saved state
+      client.commit_parameters();
+      save_session(capture_session({&client}), target);
+      return;
+    }
+    if (path == "add" || path == "remove") {
+      if (args.empty() || !std::holds_alternative<std::string>(args[0])) {
+        throw std::invalid_argument("Expected an instance type or name");
+      }
+      const std::string &first = std::get<std::string>(args[0]);
+      if (path == "remove") {
+        if (!client.remove_instance(first)) {
+          throw std::invalid_argument("No instance " + first);
+        }
+        return;
+      }
+      std::string name;
+      if (args.size() > 1 && std::holds_alternative<std::string>(args[1])) {
+        name = std::get<std::string>(args[1]);
+      }
+      // The integers after the type and name: voices, then oversampling
+      std::vector<int32_t> numbers;
+      for (size_t a = 1; a < args.size(); ++a) {
+        if (const int32_t *number = std::get_if<int32_t>(&args[a])) {
+          numbers.push_back(*number);
+        }
+      }
+      add(first, std::move(name),
+          numbers.size() > 0 ? numbers[0] : default_voices,
+          numbers.size() > 1 ? numbers[1] : default_oversampling);
+      return;
+    }
+
+    const size_t slash = path.find('/');
+    if (slash == std::string::npos) {
+      throw std::invalid_argument("Unknown command");
+    }
+    JackClient::Instance *instance =
+        client.find_instance(path.substr(0, slash));
+    if (!instance) {
+      throw std::invalid_argument("No instance " + path.substr(0, slash));
+    }
+    const std::string target = path.substr(slash + 1);
+    DSP *dsp = instance->get_dsp();
+
+    if (target == "note_on" || target == "note_off") {
+      if (args.empty() || !std::holds_alternative<int32_t>(args[0])) {
+        throw std::invalid_argument("Expected a note number");
+      }
+      const int note = std::get<int32_t>(args[0]);
+      if (target == "note_off") {
+        dsp->note_off(note);
+        return;
+      }
+      float velocity = 1.0f;
+      if (args.size() > 1 && std::holds_alternative<float>(args[1])) {
+        velocity = std::get<float>(args[1]);
+      }
+      dsp->note_on(note, velocity);
+      return;
+    }
+
+    const ParameterId id = dsp->find_parameter(target);
+    if (id == INVALID_PARAMETER) {
+      throw std::invalid_argument("No parameter " + target);
+    }
+    const ParameterDescriptor &descriptor =
+        dsp->get_parameter_descriptors()[id];
+    std::optional<ParameterValue> value;
+    if (args.size() == 1) {
+      value = to_parameter_value(descriptor, args[0]);
+    }
+    if (!value) {
+      throw std::invalid_argument("Wrong argument for " + target);
+    }
+    client.set_parameter(*instance, id, *value);
+  }
+
+  // Where /dearjack/save writes: the --session file for an empty name,
+  // otherwise name inside its directory. Anyone who can reach the port can
+  // save, so absolute paths and ".." are refused rather than letting them
+  // overwrite whatever the daemon's user can write.
+  std::string save_path(const std::string &name) const {
+    namespace fs = std::filesystem;
+    if (name.empty()) {
+      if (session_path.empty()) {
+        throw std::invalid_argument("No --session path to save to");
+      }
+      return session_path;
+    }
+    const fs::path relative(name);
+    if (relative.is_absolute() || !relative.has_filename()) {
+      throw std::invalid_argument("Save path " + name +
+                                  " must be a relative file name");
+    }
+    for (const fs::path &part : relative) {
+      if (part == "..") {
+        throw std::invalid_argument("Save path " + name +
+                                    " must not leave the session directory");
+      }
+    }
+    return (fs::path(session_path).parent_path() / relative).string();
+  }
+
+  // Earlier updates of this batch are committed first, so the reply is
+  // consistent with the version it reports
+  void reply_changes(uint64_t since, OscServer &server) {
+    const uint64_t version = client.commit_parameters();
+    for (const auto &instance : client.get_instances()) {
+      const auto &descriptors =
+          instance->get_dsp()->get_parameter_descriptors();
+      instance->parameters.for_each_changed_since(
+          since, [&](ParameterId id, const ParameterValue &value, uint64_t) {
+            server.reply({ADDRESS_PREFIX + instance->name + "/" +
+                              descriptors[id].name,
+                          {to_osc_argument(value)}});
+          });
+    }
+    server.reply({std::string(ADDRESS_PREFIX) + "version",
+                  {static_cast<int32_t>(version)}});
+  }
+
+  JackClient client;
+  PluginLoader plugins;
+  std::string session_path;
+  int default_voices;
+  int default_oversampling;
+  int instance_count = 0;
+  int worker_priority = 0;
+  bool quit = false;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (options.plugin_directory.empty()) {
+    const char *plugin_env = std::getenv("DEARJACK_PLUGIN_DIR");
+    options.plugin_directory = plugin_env ? plugin_env : "plugins";
+  }
+
+  register_builtin_dsps();
+  // DEARJACK_WORKER_CPUS restricts the workers as it does for the GUI
+  PlacementPolicy placement;
+  if (const char *worker_cpus = std::getenv("DEARJACK_WORKER_CPUS")) {
+    placement.allowed_cpus = ThreadManager::parse_cpu_list(worker_cpus);
+  }
+  ThreadManager::init(std::thread::hardware_concurrency(), placement);
+  Reclaimer::start();
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+  std::signal(SIGHUP, request_rescan);
+
+  int status = 0;
+  try {
+    Daemon daemon(options.client_name, options.plugin_directory,
+                  options.session_path, options.voices, options.oversampling);
+    if (!options.session_path.empty()) {
+      daemon.restore(load_session(options.session_path));
+    }
+    for (const std::string &spec : options.instances) {
+      const size_t colon = spec.find(':');
+      daemon.add(spec.substr(0, colon),
+                 colon == std::string::npos ? "" : spec.substr(colon + 1),
+                 options.voices, options.oversampling);
+    }
+    OscServer server(options.port, options.bind_address);
+    std::cerr << "Listening for OSC on UDP " << options.bind_address << ":"
+              << server.get_port() << std::endl;
+
+    while (!stop_requested && !daemon.quit_requested()) {
+      server.poll(POLL_TIMEOUT_MS, [&](const OscMessage &message) {
+        daemon.handle(message, server);
+      });
+      daemon.flush();
+      if (rescan_requested) {
+        rescan_requested = 0;
+        daemon.rescan();
+      }
+      daemon.housekeeping();
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    status = 1;
+  }
+
+  // The client has closed; stop the threads it may still have queued work on
+  Reclaimer::shutdown();
+  ThreadManager::shutdown();
+  return status;
+}
@@ -0,0 +1,98 @@
+/*
+ * C ABI for DSP plugins: shared objects that add DSP types to a running
+ * DearJack without rebuilding or restarting it.
+ *
+ * A plugin exports dearjack_plugin_entry (see DEARJACK_PLUGIN_ENTRY), which
+ * returns a static DearJackPlugin describing its types. The host loads every
+ * plugin in its plugin directory at startup and again on each re-scan;
+ * types from a changed plugin replace the previous version's for new
+ * instances, while running instances keep the code they were created with.
+ *
+ * Only C types cross the boundary, so plugins can be built with any
+ * compiler and need nothing but this header. Any change to the structs
+ * below increments DEARJACK_PLUGIN_ABI_VERSION, and the host refuses
+ * plugins built against another version.
+ *
+ * Threading: calls on one instance never overlap. create, destroy and
+ * prepare run outside the audio thread; process, set_parameter, note_on and
+ * note_off run on it and must not block or allocate.
+ */
+#ifndef DEARJACK_PLUGIN_H
+#define DEARJACK_PLUGIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEARJACK_PLUGIN_ABI_VERSION 1
+#define DEARJACK_PLUGIN_ENTRY "dearjack_plugin_entry"
+
+#define DEARJACK_EXPORT __attribute__((visibility("default")))
+
+enum {
+  DEARJACK_PARAMETER_FLOAT = 0,
+  /* Passed to set_parameter as a float holding a whole number */
+  DEARJACK_PARAMETER_INT = 1
+};
+
+/* DearJackDSPType flags */
+enum {
+  /* The type handles notes itself (note_on and note_off are set) and gets
+   * a MIDI input. Other types are hosted one instance per voice, with a
+   * parameter named "frequency" set to each note's pitch. */
+  DEARJACK_DSP_POLYPHONIC = 1u << 0
+};
+
+typedef struct DearJackParameter {
+  const char *name;
+  uint32_t type; /* DEARJACK_PARAMETER_* */
+  float min_value;
+  float max_value;
+  float default_value;
+} DearJackParameter;
+
+typedef struct DearJackDSPType {
+  /* Name in the DSP factory; must not clash with a built-in type */
+  const char *name;
+  uint32_t num_inputs;
+  uint32_t num_outputs;
+  uint32_t flags; /* DEARJACK_DSP_* */
+  /* Frames the outputs lag the inputs by */
+  uint32_t latency;
+  /* Parameter ids are indices into this table */
+  uint32_t num_parameters;
+  const DearJackParameter *parameters;
+
+  /* Returns a new instance, or NULL on failure */
+  void *(*create)(void);
+  void (*destroy)(void *dsp);
+  /* Before the first process and whenever the rate or buffer size changes;
+   * process then never gets more than max_block frames */
+  void (*prepare)(void *dsp, double sample_rate, uint32_t max_block);
+  void (*process)(void *dsp, uint32_t nframes, const float *const *inputs,
+                  float *const *outputs);
+  /* Called with every parameter's value before the first process, then with
+   * each change, at the start of a block */
+  void (*set_parameter)(void *dsp, uint32_t id, float value);
+  /* Polyphonic types only, otherwise NULL. velocity is in [0, 1]. */
+  void (*note_on)(void *dsp, int note, float velocity);
+  void (*note_off)(void *dsp, int note);
+} DearJackDSPType;
+
+typedef struct DearJackPlugin {
+  uint32_t abi_version; /* DEARJACK_PLUGIN_ABI_VERSION */
+  uint32_t num_types;
+  const DearJackDSPType *types;
+} DearJackPlugin;
+
+/* The entry point's type. The returned description and everything it
+ * points to must stay valid while the plugin is loaded. */
+typedef const DearJackPlugin *(*DearJackPluginEntry)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEARJACK_PLUGIN_H */
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "midi.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <jack/jack.h>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Constants
+constexpr double TWO_PI = 2.0 * M_PI;
+constexpr float DEFAULT_FREQUENCY = 440.0f;
+constexpr float DEFAULT_AMPLITUDE = 0.5f;
+constexpr float DEFAULT_SMOOTHING_TIME = 0.02f; // Seconds
+
+// Parameter identifiers are indices into a DSP's descriptor table
+using ParameterId = uint32_t;
+using ParameterValue = std::variant<float, int, std::string>;
+constexpr ParameterId INVALID_PARAMETER = ~ParameterId{0};
+
+enum class ParameterType { Float, Int, String };
+
+// How a DSP moves a Float parameter toward a new value: Linear ramps cover
+// the distance in smoothing_time, Exponential approaches it with
+// smoothing_time as the time constant
+enum class Smoothing { None, Linear, Exponential };
+
+// Describes one parameter of a DSP. Ranges apply to Float and Int types.
+struct ParameterDescriptor {
+  ParameterId id;
+  std::string name;
+  ParameterType type;
+  float min_value;
+  float max_value;
+  float default_value;
+  Smoothing smoothing = Smoothing::None;
+  float smoothing_time = 0.0f; // Seconds
+};
+
+// Voices a DSP is sounding out of how many it can
+struct VoiceUsage {
+  uint32_t active = 0;
+  uint32_t total = 0;
+};
+
+// Numeric view of a parameter value, accepting either float or int
+inline float parameter_as_float(const ParameterValue &value) {
+  if (const float *f = std::get_if<float>(&value)) {
+    return *f;
+  }
+  if (const int *i = std::get_if<int>(&value)) {
+    return static_cast<float>(*i);
+  }
+  return 0.0f;
+}
+
+// Abstract DSP base class defining the interface
+class DSP {
+public:
+  virtual ~DSP() = default;
+
+  virtual void process_audio(jack_nframes_t nframes, float **inputs,
+                             float **outputs, double sample_rate) = 0;
+  virtual int get_num_inputs() const = 0;
+  virtual int get_num_outputs() const = 0;
+
+  // Parameter table, built once per DSP type. The id of each descriptor is
+  // its index in the table.
+  virtual const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const = 0;
+  virtual void set_parameter(ParameterId id, const ParameterValue &value) = 0;
+  virtual ParameterValue get_parameter(ParameterId id) const = 0;
+
+  // String-based parameter API, kept for compatibility. Prefer ids.
+  ParameterId find_parameter(const std::string &name) const {
+    for (const auto &descriptor : get_parameter_descriptors()) {
+      if (descriptor.name == name) {
+        return descriptor.id;
+      }
+    }
+    return INVALID_PARAMETER;
+  }
+
+  void set_parameter(const std::string &name, const ParameterValue &value) {
+    const ParameterId id = find_parameter(name);
+    if (id != INVALID_PARAMETER) {
+      set_parameter(id, value);
+    }
+  }
+
+  ParameterValue get_parameter(const std::string &name) const {
+    const ParameterId id = find_parameter(name);
+    if (id == INVALID_PARAMETER) {
+      throw std::runtime_error("Unknown parameter: " + name);
+    }
+    return get_parameter(id);
+  }
+
+  std::vector<std::string> get_parameter_names() const {
+    std::vector<std::string> names;
+    for (const auto &descriptor : get_parameter_descriptors()) {
+      names.push_back(descriptor.name);
+    }
+    return names;
+  }
+
+  // Called outside the process callback before the first block and whenever
+  // JACK's sample rate or buffer size changes. DSPs size their scratch
+  // memory and compute their per-rate coefficients here so that
+  // process_audio never allocates or redoes that work. process_audio then
+  // receives the same sample_rate and nframes never exceeds max_block.
+  virtual void prepare(double sample_rate, jack_nframes_t max_block) {}
+
+  // Note messages from the control thread, with note as a MIDI note number
+  // and velocity in [0, 1]. DSPs without voices ignore them.
+  virtual void note_on(int note, float velocity) {}
+  virtual void note_off(int note) {}
+
+  // Control thread only. Hands over parameter changes an earlier
+  // set_parameter could not queue for the audio thread, e.g. because the
+  // queue was full. A JackClient calls it on every commit_parameters, so the
+  // last value of an edit gets through without waiting for another one.
+  virtual void flush_parameters() {}
+
+  // Makes smoothed parameters jump to their targets at the next block
+  // instead of ramping, e.g. when a silent voice starts a new note. Audio
+  // thread only.
+  virtual void reset_smoothing() {}
+
+  // DSPs that return true get a MIDI input port when hosted by a JackClient
+  virtual bool receives_midi() const { return false; }
+  // Applies one MIDI event at its place in the block. Audio thread only;
+  // called by process_events between the pieces of the block.
+  virtual void handle_event(const MidiEvent &event) {}
+
+  // Voice usage as of the last block, for the meters. DSPs without voices
+  // report none. Audio thread only; a JackClient reads it after each block.
+  virtual VoiceUsage get_voice_usage() const { return {}; }
+
+  // Frames the outputs lag the inputs by, e.g. through the filters of an
+  // OversampledDSP. A JackClient reports it as its ports' latency. Fixed
+  // once the DSP is constructed; any thread.
+  virtual jack_nframes_t get_latency() const { return 0; }
+
+  // Renders a block with events sorted by offset applied sample-accurately:
+  // the block is split at each event's offset and handle_event runs between
+  // the pieces. The pointers in inputs and outputs are advanced in place.
+  void process_events(jack_nframes_t nframes, float **inputs, float **outputs,
+                      double sample_rate, const MidiEvent *events,
+                      size_t num_events) {
+    jack_nframes_t done = 0;
+    for (size_t e = 0; e <= num_events; ++e) {
+      const jack_nframes_t until =
+          e < num_events ? std::min(events[e].offset, nframes) : nframes;
+      if (until > done) {
+        const jack_nframes_t frames = until - done;
+        process_audio(frames, inputs, outputs, sample_rate);
+        for (int ch = 0; ch < get_num_inputs(); ++ch) {
+          inputs[ch] += frames;
+        }
+        for (int ch = 0; ch < get_num_outputs(); ++ch) {
+          outputs[ch] += frames;
+        }
+        done = until;
+      }
+      if (e < num_events) {
+        handle_event(events[e]);
+      }
+    }
+  }
+};
+
+// Frequency of a MIDI note number in equal temperament, A4 = 440 Hz
+inline float note_to_frequency(int note) {
+  return 440.0f * std::exp2((static_cast<float>(note) - 69.0f) / 12.0f);
+}
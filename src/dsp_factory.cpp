@@ -0,0 +1,86 @@
+#include "dsp_factory.h"
+
+#include "dsp_graph.h"
+#include "fused_graph.h"
+#include "oversampled_dsp.h"
+#include "pitched_dsp.h"
+#include "polyphonic_dsp.h"
+#include <cmath>
+
+// Registers a DSPGraph of detuned band-limited saws summed to one output,
+// tuned together through its "frequency" parameter
+void register_saw_stack(const std::string &name) {
+  DSPFactory::instance().register_dsp(name, []() -> std::unique_ptr<DSP> {
+    auto graph = std::make_unique<DSPGraph>(0, 1);
+    const float detune_cents[] = {-12.0f, 0.0f, 12.0f};
+    std::vector<PitchedDSP::Target> targets;
+    for (int i = 0; i < 3; ++i) {
+      auto saw = std::make_unique<BandLimitedSawWave>();
+      saw->set_parameter(Oscillator::FREQUENCY,
+                         DEFAULT_FREQUENCY *
+                             std::exp2(detune_cents[i] / 1200.0f));
+      saw->set_parameter(Oscillator::AMPLITUDE, DEFAULT_AMPLITUDE / 3.0f);
+      const auto node =
+          graph->add_node("saw" + std::to_string(i + 1), std::move(saw));
+      graph->connect(node, 0, DSPGraph::GRAPH_IO, 0);
+      targets.push_back({"saw" + std::to_string(i + 1) + "/frequency",
+                         std::exp2(detune_cents[i] / 1200.0f)});
+    }
+    graph->commit();
+    return std::make_unique<PitchedDSP>(std::move(graph), targets);
+  });
+}
+
+// Registers a FusedGraphDSP voicing a major triad through one gain stage,
+// tuned together through its "frequency" parameter
+void register_fused_chord(const std::string &name) {
+  DSPFactory::instance().register_dsp(name, []() -> std::unique_ptr<DSP> {
+    using Kind = FusedNode::Kind;
+    FusedGraphSpec spec;
+    spec.nodes = {
+        {Kind::Sine, "root", {}, DEFAULT_FREQUENCY, DEFAULT_AMPLITUDE / 3.0f},
+        {Kind::Sine, "third", {}, DEFAULT_FREQUENCY * 1.25f,
+         DEFAULT_AMPLITUDE / 3.0f},
+        {Kind::Saw, "fifth", {}, DEFAULT_FREQUENCY * 1.5f,
+         DEFAULT_AMPLITUDE / 3.0f},
+        {Kind::Mix, "mix", {0, 1, 2}},
+        {Kind::Gain, "master", {3}, 1.0f},
+    };
+    spec.outputs = {4};
+    return std::make_unique<PitchedDSP>(
+        std::make_unique<FusedGraphDSP>(std::move(spec)),
+        std::vector<PitchedDSP::Target>{{"root/frequency", 1.0f},
+                                        {"third/frequency", 1.25f},
+                                        {"fifth/frequency", 1.5f}});
+  });
+}
+
+void register_builtin_dsps() {
+  register_oscillator<SineWaveform>("SinOsc");
+  register_oscillator<SquareWaveform>("SquareWave");
+  register_oscillator<SawWaveform>("SawWave");
+  register_oscillator<BandLimitedSquareWaveform>("SquareWaveBL");
+  register_oscillator<BandLimitedSawWaveform>("SawWaveBL");
+  register_saw_stack("SawStack");
+  register_fused_chord("FusedChord");
+  register_oscillator_bank<SineWaveform>("SinBank");
+  register_oscillator_bank<SquareWaveform>("SquareBank");
+  register_oscillator_bank<SawWaveform>("SawBank");
+}
+
+std::unique_ptr<DSP> create_instance_dsp(const std::string &type,
+                                         int num_voices, int oversampling) {
+  std::unique_ptr<DSP> dsp;
+  if (DSPFactory::instance().is_polyphonic(type)) {
+    dsp = DSPFactory::instance().create_dsp(type, num_voices);
+  } else {
+    dsp = std::make_unique<PolyphonicDSP>(
+        [type]() { return DSPFactory::instance().create_dsp(type); },
+        num_voices);
+  }
+  if (oversampling == 1) {
+    return dsp;
+  }
+  // Around the voices rather than in each, so the filters run once
+  return std::make_unique<OversampledDSP>(std::move(dsp), oversampling);
+}
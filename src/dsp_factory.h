@@ -0,0 +1,146 @@
+#pragma once
+
+#include "dsp.h"
+#include "oscillator.h"
+#include "oscillator_bank.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Thread-safe DSP factory class
+class DSPFactory {
+public:
+  using DSPCreator = std::function<std::unique_ptr<DSP>()>;
+  // Creator of a polyphonic type that sizes its own voice pool
+  using VoicedDSPCreator = std::function<std::unique_ptr<DSP>(int num_voices)>;
+
+  static DSPFactory &instance() {
+    static DSPFactory instance;
+    return instance;
+  }
+
+  // Polyphonic types handle notes themselves and are hosted as they are;
+  // the others are wrapped in a PolyphonicDSP
+  void register_dsp(const std::string &name, DSPCreator creator,
+                    bool polyphonic = false) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    creators[name] = std::move(creator);
+    voiced_creators.erase(name);
+    if (polyphonic) {
+      polyphonic_types.insert(name);
+    } else {
+      polyphonic_types.erase(name);
+    }
+  }
+
+  // Registers a polyphonic type that takes its voice count from
+  // create_dsp(name, num_voices); plain create_dsp gets default_voices
+  void register_voiced_dsp(const std::string &name, VoicedDSPCreator creator,
+                           int default_voices) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    creators[name] = [creator, default_voices]() {
+      return creator(default_voices);
+    };
+    voiced_creators[name] = std::move(creator);
+    polyphonic_types.insert(name);
+  }
+
+  // Removes a type; DSPs already created from it are unaffected
+  void unregister_dsp(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    creators.erase(name);
+    voiced_creators.erase(name);
+    polyphonic_types.erase(name);
+  }
+
+  bool has_dsp(const std::string &name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return creators.count(name) != 0;
+  }
+
+  bool is_polyphonic(const std::string &name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return polyphonic_types.count(name) != 0;
+  }
+
+  std::unique_ptr<DSP> create_dsp(const std::string &name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = creators.find(name);
+    if (it != creators.end()) {
+      return it->second();
+    }
+    throw std::runtime_error("Unknown DSP type: " + name);
+  }
+
+  // As create_dsp, passing num_voices to types registered with
+  // register_voiced_dsp; other types ignore it
+  std::unique_ptr<DSP> create_dsp(const std::string &name,
+                                  int num_voices) const {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = voiced_creators.find(name);
+      if (it != voiced_creators.end()) {
+        return it->second(num_voices);
+      }
+    }
+    return create_dsp(name);
+  }
+
+  std::vector<std::string> get_registered_dsps() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> dsp_names;
+    for (const auto &[key, _] : creators) {
+      dsp_names.push_back(key);
+    }
+    return dsp_names;
+  }
+
+private:
+  DSPFactory() = default;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, DSPCreator> creators;
+  std::unordered_map<std::string, VoicedDSPCreator> voiced_creators;
+  std::unordered_set<std::string> polyphonic_types;
+};
+
+// Registers BasicOscillator<Waveform> under the given name
+template <typename Waveform> void register_oscillator(const std::string &name) {
+  DSPFactory::instance().register_dsp(name, []() -> std::unique_ptr<DSP> {
+    return std::make_unique<BasicOscillator<Waveform>>();
+  });
+}
+
+// Registers OscillatorBank<Waveform> as a polyphonic type with as many
+// voices as the instance asks for
+template <typename Waveform>
+void register_oscillator_bank(const std::string &name) {
+  DSPFactory::instance().register_voiced_dsp(
+      name,
+      [](int num_voices) -> std::unique_ptr<DSP> {
+        return std::make_unique<OscillatorBank<Waveform>>(num_voices);
+      },
+      static_cast<int>(OscillatorBank<Waveform>::MAX_VOICES));
+}
+
+// Registers a DSPGraph of detuned band-limited saws summed to one output,
+// tuned together through its "frequency" parameter
+void register_saw_stack(const std::string &name);
+
+// Registers a FusedGraphDSP voicing a major triad through one gain stage,
+// tuned together through its "frequency" parameter
+void register_fused_chord(const std::string &name);
+
+// Registers every built-in DSP type under its usual name
+void register_builtin_dsps();
+
+// DSP for a new client instance of the given type: polyphonic types are used
+// as-is, with num_voices voices if they size their own pool, and others are
+// wrapped in a PolyphonicDSP of num_voices voices. An oversampling factor of 2,
+// 4 or 8 runs the result in an OversampledDSP; 1 runs it at the host rate.
+std::unique_ptr<DSP> create_instance_dsp(const std::string &type,
+                                         int num_voices, int oversampling = 1);
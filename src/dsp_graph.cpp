@@ -0,0 +1,396 @@
+#include "dsp_graph.h"
+#include "simd.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <stdexcept>
+
+DSPGraph::DSPGraph(int num_inputs, int num_outputs)
+    : num_inputs(num_inputs), num_outputs(num_outputs) {
+  commit();
+}
+
+DSPGraph::NodeId DSPGraph::add_node(const std::string &name,
+                                    std::unique_ptr<DSP> dsp) {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  if (max_block > 0) {
+    dsp->prepare(sample_rate, max_block);
+  }
+  nodes.push_back({name, std::move(dsp)});
+  rebuild_descriptors();
+  return static_cast<NodeId>(nodes.size() - 1);
+}
+
+void DSPGraph::remove_node(NodeId node) {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  node_at(node);
+  std::erase_if(edges, [node](const Edge &edge) {
+    return edge.from == node || edge.to == node;
+  });
+  // The committed schedule holds its own reference until it is replaced
+  nodes[node].dsp.reset();
+  rebuild_descriptors();
+}
+
+void DSPGraph::connect(NodeId from, int from_port, NodeId to, int to_port) {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  if (from_port < 0 || from_port >= num_ports(from, true) || to_port < 0 ||
+      to_port >= num_ports(to, false)) {
+    throw std::invalid_argument("DSPGraph: no such port");
+  }
+  const Edge edge{from, from_port, to, to_port};
+  if (std::find(edges.begin(), edges.end(), edge) != edges.end()) {
+    return;
+  }
+  edges.push_back(edge);
+  try {
+    compute_levels();
+  } catch (...) {
+    edges.pop_back();
+    throw;
+  }
+}
+
+void DSPGraph::disconnect(NodeId from, int from_port, NodeId to,
+                          int to_port) {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  std::erase(edges, Edge{from, from_port, to, to_port});
+}
+
+void DSPGraph::commit() {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  schedule.publish(compile());
+}
+
+size_t DSPGraph::get_num_buffers() const {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  return schedule.get().num_buffers;
+}
+
+void DSPGraph::set_parameter(ParameterId id, const ParameterValue &value) {
+  if (id >= parameter_targets.size()) {
+    return;
+  }
+  const auto [node, node_parameter] = parameter_targets[id];
+  nodes[node].dsp->set_parameter(node_parameter, value);
+}
+
+ParameterValue DSPGraph::get_parameter(ParameterId id) const {
+  if (id >= parameter_targets.size()) {
+    throw std::runtime_error("Unknown parameter id: " + std::to_string(id));
+  }
+  const auto [node, node_parameter] = parameter_targets[id];
+  return nodes[node].dsp->get_parameter(node_parameter);
+}
+
+// JACK stops processing while the buffer size changes, so the schedule can
+// be rebuilt with larger buffers here
+void DSPGraph::prepare(double rate, jack_nframes_t max_frames) {
+  std::lock_guard<std::mutex> lock(edit_mutex);
+  sample_rate = rate;
+  max_block = max_frames;
+  for (const auto &node : nodes) {
+    if (node.dsp) {
+      node.dsp->prepare(rate, max_frames);
+    }
+  }
+  schedule.publish(compile());
+}
+
+void DSPGraph::reset_smoothing() {
+  for (const auto &step : schedule.read()->steps) {
+    step.dsp->reset_smoothing();
+  }
+}
+
+void DSPGraph::process_audio(jack_nframes_t nframes, float **inputs,
+                             float **outputs, double sample_rate) {
+  const Schedule &current = *schedule.read();
+  current.block_inputs = inputs;
+  current.block_frames = nframes;
+  current.block_sample_rate = sample_rate;
+
+  const size_t num_levels = current.level_begin.size() - 1;
+  for (size_t level = 0; level < num_levels; ++level) {
+    const size_t begin = current.level_begin[level];
+    const size_t count = current.level_begin[level + 1] - begin;
+
+    // Independent nodes of a level go to the workers when there is enough
+    // work to pay for the fork and join; the audio thread takes part, and
+    // runs them itself if the pool is busy
+    if (count > 1 && ThreadManager::num_participants() > 1 &&
+        count * nframes >=
+            parallel_threshold.load(std::memory_order_relaxed)) {
+      LevelContext context{&current, begin};
+      if (ThreadManager::try_parallel_for(static_cast<unsigned>(count),
+                                          run_parallel_step, &context)) {
+        continue;
+      }
+    }
+    for (size_t i = begin; i < begin + count; ++i) {
+      run_step(current, current.steps[i]);
+    }
+  }
+
+  for (int k = 0; k < num_outputs; ++k) {
+    const auto &sources = current.graph_outputs[k];
+    if (sources.empty()) {
+      std::fill_n(outputs[k], nframes, 0.0f);
+      continue;
+    }
+    for (size_t i = 0; i < sources.size(); ++i) {
+      const float *source = sources[i].graph_input >= 0
+                                ? inputs[sources[i].graph_input]
+                                : sources[i].buffer;
+      if (i == 0) {
+        std::copy_n(source, nframes, outputs[k]);
+      } else {
+        simd::add_to(outputs[k], source, nframes);
+      }
+    }
+  }
+}
+
+void DSPGraph::run_step(const Schedule &schedule, const Step &step) {
+  const jack_nframes_t frames = schedule.block_frames;
+  for (const auto &fill : step.fills) {
+    for (size_t i = 0; i < fill.sources.size(); ++i) {
+      const Source &source = fill.sources[i];
+      float *data = source.graph_input >= 0
+                        ? schedule.block_inputs[source.graph_input]
+                        : source.buffer;
+      if (!fill.sum) {
+        step.inputs[fill.input] = data;
+      } else if (i == 0) {
+        std::copy_n(data, frames, fill.sum);
+      } else {
+        simd::add_to(fill.sum, data, frames);
+      }
+    }
+  }
+  step.dsp->process_audio(frames, step.inputs.data(),
+                          const_cast<float **>(step.outputs.data()),
+                          schedule.block_sample_rate);
+}
+
+void DSPGraph::run_parallel_step(void *context, unsigned index, unsigned) {
+  const auto *level = static_cast<const LevelContext *>(context);
+  run_step(*level->schedule, level->schedule->steps[level->begin + index]);
+}
+
+const DSPGraph::Node &DSPGraph::node_at(NodeId node) const {
+  if (node >= nodes.size() || !nodes[node].dsp) {
+    throw std::invalid_argument("DSPGraph: no such node");
+  }
+  return nodes[node];
+}
+
+int DSPGraph::num_ports(NodeId node, bool output) const {
+  if (node == GRAPH_IO) {
+    // The graph's inputs are sources and its outputs are destinations
+    return output ? num_inputs : num_outputs;
+  }
+  const DSP &dsp = *node_at(node).dsp;
+  return output ? dsp.get_num_outputs() : dsp.get_num_inputs();
+}
+
+// Kahn's algorithm, one frontier at a time: a node's level is the length of
+// the longest path from a node without inputs
+std::vector<int> DSPGraph::compute_levels() const {
+  std::vector<int> levels(nodes.size(), -1);
+  std::vector<int> pending(nodes.size(), 0);
+  for (const auto &edge : edges) {
+    if (edge.from != GRAPH_IO && edge.to != GRAPH_IO) {
+      ++pending[edge.to];
+    }
+  }
+
+  std::vector<NodeId> frontier;
+  size_t live_nodes = 0;
+  for (NodeId n = 0; n < nodes.size(); ++n) {
+    if (nodes[n].dsp) {
+      ++live_nodes;
+      if (pending[n] == 0) {
+        frontier.push_back(n);
+      }
+    }
+  }
+
+  size_t placed = 0;
+  std::vector<NodeId> next;
+  for (int level = 0; !frontier.empty(); ++level) {
+    next.clear();
+    for (NodeId n : frontier) {
+      levels[n] = level;
+      ++placed;
+      for (const auto &edge : edges) {
+        if (edge.from == n && edge.to != GRAPH_IO && --pending[edge.to] == 0) {
+          next.push_back(edge.to);
+        }
+      }
+    }
+    frontier.swap(next);
+  }
+
+  if (placed != live_nodes) {
+    throw std::invalid_argument("DSPGraph: connection would form a cycle");
+  }
+  return levels;
+}
+
+std::unique_ptr<DSPGraph::Schedule> DSPGraph::compile() const {
+  auto compiled = std::make_unique<Schedule>();
+  const std::vector<int> levels = compute_levels();
+  const int num_levels =
+      levels.empty() ? 0 : *std::max_element(levels.begin(), levels.end()) + 1;
+
+  std::vector<NodeId> order;
+  for (NodeId n = 0; n < nodes.size(); ++n) {
+    if (nodes[n].dsp) {
+      order.push_back(n);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&](NodeId a, NodeId b) {
+    return levels[a] < levels[b];
+  });
+
+  auto inputs_of = [&](NodeId to, int port) {
+    std::vector<const Edge *> found;
+    for (const auto &edge : edges) {
+      if (edge.to == to && edge.to_port == port) {
+        found.push_back(&edge);
+      }
+    }
+    return found;
+  };
+
+  // Last level reading each node output. Graph outputs are read after the
+  // final level, and unread outputs die at their own level.
+  std::vector<std::vector<int>> last_use(nodes.size());
+  for (NodeId n : order) {
+    last_use[n].assign(nodes[n].dsp->get_num_outputs(), levels[n]);
+  }
+  for (const auto &edge : edges) {
+    if (edge.from == GRAPH_IO) {
+      continue;
+    }
+    const int reader = edge.to == GRAPH_IO ? num_levels : levels[edge.to];
+    int &use = last_use[edge.from][edge.from_port];
+    use = std::max(use, reader);
+  }
+
+  // Assign buffers level by level. A buffer is only handed out again at a
+  // level after its last reader, since nodes within a level run
+  // concurrently.
+  std::vector<std::vector<int>> output_buffer(nodes.size());
+  std::vector<std::vector<int>> sum_buffer(nodes.size());
+  std::vector<int> free_buffers;
+  std::vector<std::pair<int, int>> busy; // (buffer, last use)
+  size_t num_buffers = 0;
+  auto acquire = [&](int until) {
+    int buffer;
+    if (!free_buffers.empty()) {
+      buffer = free_buffers.back();
+      free_buffers.pop_back();
+    } else {
+      buffer = static_cast<int>(num_buffers++);
+    }
+    busy.emplace_back(buffer, until);
+    return buffer;
+  };
+
+  for (size_t i = 0; i < order.size();) {
+    const int level = levels[order[i]];
+    std::erase_if(busy, [&](const std::pair<int, int> &entry) {
+      if (entry.second < level) {
+        free_buffers.push_back(entry.first);
+        return true;
+      }
+      return false;
+    });
+    for (; i < order.size() && levels[order[i]] == level; ++i) {
+      const NodeId n = order[i];
+      const DSP &dsp = *nodes[n].dsp;
+      sum_buffer[n].assign(dsp.get_num_inputs(), -1);
+      for (int port = 0; port < dsp.get_num_inputs(); ++port) {
+        if (inputs_of(n, port).size() > 1) {
+          sum_buffer[n][port] = acquire(level);
+        }
+      }
+      output_buffer[n].resize(dsp.get_num_outputs());
+      for (int port = 0; port < dsp.get_num_outputs(); ++port) {
+        output_buffer[n][port] = acquire(last_use[n][port]);
+      }
+    }
+  }
+
+  // One extra buffer of silence for unconnected inputs
+  const size_t frames = std::max<jack_nframes_t>(max_block, 1);
+  compiled->num_buffers = num_buffers;
+  compiled->memory.assign((num_buffers + 1) * frames, 0.0f);
+  float *const memory = compiled->memory.data();
+  float *const silence = memory + num_buffers * frames;
+  auto buffer_at = [&](int buffer) { return memory + buffer * frames; };
+  auto source_of = [&](const Edge &edge) {
+    return edge.from == GRAPH_IO
+               ? Source{edge.from_port, nullptr}
+               : Source{-1, buffer_at(output_buffer[edge.from][edge.from_port])};
+  };
+
+  compiled->level_begin.assign(num_levels + 1, order.size());
+  for (size_t i = order.size(); i-- > 0;) {
+    compiled->level_begin[levels[order[i]]] = i;
+  }
+  for (NodeId n : order) {
+    const auto &dsp = nodes[n].dsp;
+    compiled->nodes.push_back(dsp);
+
+    Step step;
+    step.dsp = dsp.get();
+    step.inputs.assign(dsp->get_num_inputs(), silence);
+    for (int port = 0; port < dsp->get_num_inputs(); ++port) {
+      const auto feeds = inputs_of(n, port);
+      if (feeds.size() == 1 && feeds[0]->from != GRAPH_IO) {
+        step.inputs[port] = source_of(*feeds[0]).buffer;
+      } else if (!feeds.empty()) {
+        InputFill fill{static_cast<unsigned>(port), nullptr, {}};
+        if (feeds.size() > 1) {
+          fill.sum = buffer_at(sum_buffer[n][port]);
+          step.inputs[port] = fill.sum;
+        }
+        for (const Edge *feed : feeds) {
+          fill.sources.push_back(source_of(*feed));
+        }
+        step.fills.push_back(std::move(fill));
+      }
+    }
+    for (int port = 0; port < dsp->get_num_outputs(); ++port) {
+      step.outputs.push_back(buffer_at(output_buffer[n][port]));
+    }
+    compiled->steps.push_back(std::move(step));
+  }
+
+  compiled->graph_outputs.resize(num_outputs);
+  for (int k = 0; k < num_outputs; ++k) {
+    for (const Edge *feed : inputs_of(GRAPH_IO, k)) {
+      compiled->graph_outputs[k].push_back(source_of(*feed));
+    }
+  }
+  return compiled;
+}
+
+void DSPGraph::rebuild_descriptors() {
+  descriptors.clear();
+  parameter_targets.clear();
+  for (NodeId n = 0; n < nodes.size(); ++n) {
+    if (!nodes[n].dsp) {
+      continue;
+    }
+    for (const auto &descriptor : nodes[n].dsp->get_parameter_descriptors()) {
+      ParameterDescriptor exposed = descriptor;
+      exposed.id = static_cast<ParameterId>(descriptors.size());
+      exposed.name = nodes[n].name + "/" + descriptor.name;
+      descriptors.push_back(std::move(exposed));
+      parameter_targets.emplace_back(n, descriptor.id);
+    }
+  }
+}
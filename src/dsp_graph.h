@@ -0,0 +1,157 @@
+#pragma once
+
+#include "dsp.h"
+#include "rcu_cell.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// In-process graph of DSP nodes, itself a DSP.
+//
+// Edges connect a node's output port to another node's input port. Several
+// edges into one input are summed. Edits are made on the control thread and
+// take effect when commit() compiles them into a schedule. Compiling sorts
+// the nodes into levels, so that every node only depends on earlier levels,
+// and assigns buffers by liveness, so a buffer is reused once its last reader
+// has run. The audio thread picks up the new schedule through an RcuCell and
+// runs the nodes of each level in parallel on the ThreadManager workers.
+class DSPGraph : public DSP {
+public:
+  using NodeId = uint32_t;
+
+  // Endpoint for the graph's own ports: connect(GRAPH_IO, k, node, p) feeds
+  // graph input k to the node, connect(node, p, GRAPH_IO, k) feeds graph
+  // output k
+  static constexpr NodeId GRAPH_IO = ~NodeId{0};
+
+  DSPGraph(int num_inputs, int num_outputs);
+
+  // Control thread only. Node parameters are exposed as "<name>/<param>".
+  NodeId add_node(const std::string &name, std::unique_ptr<DSP> dsp);
+  void remove_node(NodeId node);
+  // Throws std::invalid_argument for unknown ports and if the edge would
+  // close a cycle
+  void connect(NodeId from, int from_port, NodeId to, int to_port);
+  void disconnect(NodeId from, int from_port, NodeId to, int to_port);
+  // Compiles the current nodes and edges and hands the schedule to the audio
+  // thread
+  void commit();
+
+  // Number of distinct scratch buffers the committed schedule uses
+  size_t get_num_buffers() const;
+
+  // Minimum nodes * frames in a level before its nodes are rendered on the
+  // worker pool; below it the fork/join overhead outweighs the gain, as in
+  // PolyphonicDSP. SIZE_MAX keeps rendering serial.
+  void set_parallel_threshold(size_t node_frames) {
+    parallel_threshold.store(node_frames, std::memory_order_relaxed);
+  }
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return descriptors;
+  }
+  void set_parameter(ParameterId id, const ParameterValue &value) override;
+  ParameterValue get_parameter(ParameterId id) const override;
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override;
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double sample_rate) override;
+  void reset_smoothing() override;
+  int get_num_inputs() const override { return num_inputs; }
+  int get_num_outputs() const override { return num_outputs; }
+
+private:
+  struct Node {
+    std::string name;
+    std::shared_ptr<DSP> dsp; // Null once removed
+  };
+
+  struct Edge {
+    NodeId from;
+    int from_port;
+    NodeId to;
+    int to_port;
+    bool operator==(const Edge &) const = default;
+  };
+
+  // Where a node input or graph output reads from
+  struct Source {
+    int graph_input; // Index into the graph's inputs, or -1 for buffer
+    float *buffer;
+  };
+
+  // Applied by the audio thread every block, for inputs fed by a graph input
+  // or by more than one edge
+  struct InputFill {
+    unsigned input;
+    float *sum; // Null when a single graph input is passed through
+    std::vector<Source> sources;
+  };
+
+  struct Step {
+    DSP *dsp;
+    mutable std::vector<float *> inputs; // Patched by the audio thread
+    std::vector<float *> outputs;
+    std::vector<InputFill> fills;
+  };
+
+  struct Schedule {
+    // Keeps removed nodes alive while the audio thread may still run them
+    std::vector<std::shared_ptr<DSP>> nodes;
+    std::vector<Step> steps;
+    // Steps of level l are [level_begin[l], level_begin[l + 1])
+    std::vector<size_t> level_begin;
+    std::vector<std::vector<Source>> graph_outputs;
+    std::vector<float> memory;
+    size_t num_buffers = 0;
+
+    // Set by the audio thread for the block being rendered
+    mutable float *const *block_inputs = nullptr;
+    mutable jack_nframes_t block_frames = 0;
+    mutable double block_sample_rate = 0.0;
+  };
+
+  // Steps of one level, dispatched to the workers
+  struct LevelContext {
+    const Schedule *schedule;
+    size_t begin;
+  };
+
+  const Node &node_at(NodeId node) const;
+  int num_ports(NodeId node, bool output) const;
+  // Levels of every live node; throws if the edges contain a cycle
+  std::vector<int> compute_levels() const;
+  std::unique_ptr<Schedule> compile() const;
+  void rebuild_descriptors();
+
+  static void run_step(const Schedule &schedule, const Step &step);
+  static void run_parallel_step(void *context, unsigned index,
+                                unsigned participant);
+
+  int num_inputs;
+  int num_outputs;
+  double sample_rate = 0.0;
+  jack_nframes_t max_block = 0;
+
+  // Guards the control-side state against prepare, which JACK
+  // calls from its own thread
+  mutable std::mutex edit_mutex;
+  std::vector<Node> nodes;
+  std::vector<Edge> edges;
+
+  std::vector<ParameterDescriptor> descriptors;
+  // Node and node-local id behind each graph parameter
+  std::vector<std::pair<NodeId, ParameterId>> parameter_targets;
+
+  RcuCell<Schedule> schedule;
+  std::atomic<size_t> parallel_threshold{8192};
+};
@@ -0,0 +1,541 @@
+#include "fused_graph.h"
+#include "reclaimer.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+
+// outputs, nframes, parameter slots, phases, 1 / sample rate
+using FusedKernelFn = void (*)(float **, uint32_t, const float *, double *,
+                               double);
+
+// Compiled kernel and the JIT that owns its code
+struct FusedKernel {
+  std::atomic<FusedKernelFn> fn{nullptr};
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+};
+
+namespace {
+// Lanes per iteration of the compiled loop, matching the widest SIMD path
+constexpr unsigned KERNEL_WIDTH = 8;
+
+bool is_oscillator(FusedNode::Kind kind) {
+  return kind == FusedNode::Kind::Sine || kind == FusedNode::Kind::Square ||
+         kind == FusedNode::Kind::Saw;
+}
+
+// Emits the kernel IR. The loop body is emitted twice, once on
+// <KERNEL_WIDTH x float> for the bulk of the block and once on float for the
+// tail, so both produce the same samples as the C++ oscillators.
+class KernelEmitter {
+public:
+  KernelEmitter(const FusedGraphSpec &spec, llvm::LLVMContext &context,
+                llvm::Module &module)
+      : spec(spec), context(context), builder(context) {
+    auto *float_type = builder.getFloatTy();
+    auto *double_type = builder.getDoubleTy();
+    auto *float_ptr = float_type->getPointerTo();
+    auto *function_type = llvm::FunctionType::get(
+        builder.getVoidTy(),
+        {float_ptr->getPointerTo(), builder.getInt32Ty(), float_ptr,
+         double_type->getPointerTo(), double_type},
+        false);
+    function = llvm::Function::Create(function_type,
+                                      llvm::Function::ExternalLinkage,
+                                      "fused_kernel", module);
+    for (auto &argument : function->args()) {
+      if (argument.getType()->isPointerTy()) {
+        argument.addAttr(llvm::Attribute::NoAlias);
+      }
+    }
+  }
+
+  void emit() {
+    auto *args = function->arg_begin();
+    llvm::Value *outputs = args++;
+    llvm::Value *frame_count = args++;
+    llvm::Value *slots = args++;
+    llvm::Value *phases_arg = args++;
+    llvm::Value *inverse_sample_rate = args++;
+
+    auto *entry = llvm::BasicBlock::Create(context, "entry", function);
+    builder.SetInsertPoint(entry);
+    llvm::Value *nframes = builder.CreateZExt(frame_count, builder.getInt64Ty());
+
+    // Per-block constants and the phase accumulators, promoted to registers
+    // by the optimizer
+    const size_t num_nodes = spec.nodes.size();
+    slot0.assign(num_nodes, nullptr);
+    slot1.assign(num_nodes, nullptr);
+    increments.assign(num_nodes, nullptr);
+    phases.assign(num_nodes, nullptr);
+    for (size_t n = 0; n < num_nodes; ++n) {
+      const FusedNode &node = spec.nodes[n];
+      if (node.kind == FusedNode::Kind::Mix) {
+        continue;
+      }
+      slot0[n] = load_slot(slots, n * FusedGraphDSP::SLOTS_PER_NODE);
+      if (!is_oscillator(node.kind)) {
+        continue;
+      }
+      slot1[n] = load_slot(slots, n * FusedGraphDSP::SLOTS_PER_NODE + 1);
+      increments[n] = builder.CreateFMul(
+          builder.CreateFPExt(slot0[n], builder.getDoubleTy()),
+          inverse_sample_rate);
+      phases[n] = builder.CreateAlloca(builder.getDoubleTy());
+      builder.CreateStore(
+          builder.CreateLoad(builder.getDoubleTy(),
+                             builder.CreateConstInBoundsGEP1_64(
+                                 builder.getDoubleTy(), phases_arg, n)),
+          phases[n]);
+    }
+    std::vector<llvm::Value *> output_pointers;
+    for (size_t k = 0; k < spec.outputs.size(); ++k) {
+      auto *float_ptr = builder.getFloatTy()->getPointerTo();
+      output_pointers.push_back(builder.CreateLoad(
+          float_ptr,
+          builder.CreateConstInBoundsGEP1_64(float_ptr, outputs, k)));
+    }
+
+    // for (i = 0; i + width <= n; i += width) vector body
+    // for (; i < n; ++i) scalar body
+    auto *vector_type = llvm::FixedVectorType::get(builder.getFloatTy(),
+                                                   KERNEL_WIDTH);
+    llvm::Value *index = builder.CreateAlloca(builder.getInt64Ty());
+    builder.CreateStore(builder.getInt64(0), index);
+    emit_loop(vector_type, KERNEL_WIDTH, index, nframes, output_pointers);
+    emit_loop(builder.getFloatTy(), 1, index, nframes, output_pointers);
+
+    for (size_t n = 0; n < num_nodes; ++n) {
+      if (phases[n]) {
+        builder.CreateStore(
+            builder.CreateLoad(builder.getDoubleTy(), phases[n]),
+            builder.CreateConstInBoundsGEP1_64(builder.getDoubleTy(),
+                                               phases_arg, n));
+      }
+    }
+    builder.CreateRetVoid();
+  }
+
+private:
+  llvm::Value *load_slot(llvm::Value *slots, size_t slot) {
+    return builder.CreateLoad(
+        builder.getFloatTy(),
+        builder.CreateConstInBoundsGEP1_64(builder.getFloatTy(), slots, slot));
+  }
+
+  void emit_loop(llvm::Type *type, unsigned width, llvm::Value *index,
+                 llvm::Value *nframes,
+                 const std::vector<llvm::Value *> &output_pointers) {
+    auto *condition = llvm::BasicBlock::Create(context, "cond", function);
+    auto *body = llvm::BasicBlock::Create(context, "body", function);
+    auto *done = llvm::BasicBlock::Create(context, "done", function);
+    builder.CreateBr(condition);
+
+    builder.SetInsertPoint(condition);
+    llvm::Value *i = builder.CreateLoad(builder.getInt64Ty(), index);
+    builder.CreateCondBr(
+        builder.CreateICmpULE(builder.CreateAdd(i, builder.getInt64(width)),
+                              nframes),
+        body, done);
+
+    builder.SetInsertPoint(body);
+    std::vector<llvm::Value *> values(spec.nodes.size(), nullptr);
+    for (size_t n = 0; n < spec.nodes.size(); ++n) {
+      values[n] = emit_node(n, type, width, values);
+    }
+    for (size_t k = 0; k < spec.outputs.size(); ++k) {
+      llvm::Value *pointer = builder.CreateInBoundsGEP(
+          builder.getFloatTy(), output_pointers[k], i);
+      pointer = builder.CreateBitCast(pointer, type->getPointerTo());
+      builder.CreateAlignedStore(values[spec.outputs[k]], pointer,
+                                 llvm::Align(alignof(float)));
+    }
+    builder.CreateStore(builder.CreateAdd(i, builder.getInt64(width)), index);
+    builder.CreateBr(condition);
+
+    builder.SetInsertPoint(done);
+  }
+
+  llvm::Value *emit_node(size_t n, llvm::Type *type, unsigned width,
+                         const std::vector<llvm::Value *> &values) {
+    const FusedNode &node = spec.nodes[n];
+    switch (node.kind) {
+    case FusedNode::Kind::Gain:
+      return builder.CreateFMul(values[node.inputs[0]], splat(type, slot0[n]));
+    case FusedNode::Kind::Mix: {
+      llvm::Value *sum = constant(type, 0.0);
+      for (unsigned input : node.inputs) {
+        sum = builder.CreateFAdd(sum, values[input]);
+      }
+      return sum;
+    }
+    default:
+      break;
+    }
+
+    // Lane phases from a per-node double accumulator
+    llvm::Value *phase = builder.CreateLoad(builder.getDoubleTy(), phases[n]);
+    llvm::Value *increment = increments[n];
+    llvm::Value *lane_phases = splat(
+        type, builder.CreateFPTrunc(phase, builder.getFloatTy()));
+    if (width > 1) {
+      std::vector<llvm::Constant *> ramp;
+      for (unsigned lane = 0; lane < width; ++lane) {
+        ramp.push_back(llvm::ConstantFP::get(builder.getFloatTy(),
+                                             static_cast<double>(lane)));
+      }
+      lane_phases = builder.CreateFAdd(
+          lane_phases,
+          builder.CreateFMul(
+              llvm::ConstantVector::get(ramp),
+              splat(type,
+                    builder.CreateFPTrunc(increment, builder.getFloatTy()))));
+    }
+    phase = builder.CreateFAdd(
+        phase, builder.CreateFMul(increment,
+                                  llvm::ConstantFP::get(builder.getDoubleTy(),
+                                                        width)));
+    builder.CreateStore(builder.CreateFSub(phase, floor(phase)), phases[n]);
+
+    llvm::Value *wave = nullptr;
+    switch (node.kind) {
+    case FusedNode::Kind::Sine:
+      wave = emit_sine(type, lane_phases);
+      break;
+    case FusedNode::Kind::Square: {
+      llvm::Value *x = builder.CreateFSub(lane_phases, floor(lane_phases));
+      llvm::Value *first_half =
+          builder.CreateAnd(builder.CreateFCmpOGT(x, constant(type, 0.0)),
+                            builder.CreateFCmpOLT(x, constant(type, 0.5)));
+      wave = builder.CreateSelect(first_half, constant(type, 1.0),
+                                  constant(type, -1.0));
+      break;
+    }
+    default: {
+      llvm::Value *x = builder.CreateFSub(
+          lane_phases,
+          floor(builder.CreateFAdd(lane_phases, constant(type, 0.5))));
+      wave = builder.CreateFMul(constant(type, 2.0), x);
+      break;
+    }
+    }
+    return builder.CreateFMul(wave, splat(type, slot1[n]));
+  }
+
+  // Same reduction and polynomial as simd::sin_cycles
+  llvm::Value *emit_sine(llvm::Type *type, llvm::Value *phase) {
+    llvm::Value *x = builder.CreateFSub(
+        phase, floor(builder.CreateFAdd(phase, constant(type, 0.5))));
+    x = builder.CreateSelect(builder.CreateFCmpOGT(x, constant(type, 0.25)),
+                             builder.CreateFSub(constant(type, 0.5), x), x);
+    x = builder.CreateSelect(builder.CreateFCmpOLT(x, constant(type, -0.25)),
+                             builder.CreateFSub(constant(type, -0.5), x), x);
+    llvm::Value *t =
+        builder.CreateFMul(x, constant(type, 6.28318530717958647692));
+    llvm::Value *t2 = builder.CreateFMul(t, t);
+    llvm::Value *p = constant(type, -2.50521083854417187751e-8);
+    for (double coefficient :
+         {2.75573192239858906526e-6, -1.98412698412698412698e-4,
+          8.33333333333333333333e-3, -1.66666666666666666667e-1, 1.0}) {
+      p = builder.CreateIntrinsic(llvm::Intrinsic::fmuladd, {type},
+                                  {p, t2, constant(type, coefficient)});
+    }
+    return builder.CreateFMul(p, t);
+  }
+
+  llvm::Value *floor(llvm::Value *value) {
+    return builder.CreateUnaryIntrinsic(llvm::Intrinsic::floor, value);
+  }
+
+  llvm::Constant *constant(llvm::Type *type, double value) {
+    // Rounded to float first so the constants match the C++ kernels
+    return llvm::ConstantFP::get(type,
+                                 static_cast<double>(static_cast<float>(value)));
+  }
+
+  llvm::Value *splat(llvm::Type *type, llvm::Value *scalar) {
+    if (auto *vector = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+      return builder.CreateVectorSplat(vector->getNumElements(), scalar);
+    }
+    return scalar;
+  }
+
+  const FusedGraphSpec &spec;
+  llvm::LLVMContext &context;
+  llvm::IRBuilder<> builder;
+  llvm::Function *function = nullptr;
+
+  std::vector<llvm::Value *> slot0;
+  std::vector<llvm::Value *> slot1;
+  std::vector<llvm::Value *> increments;
+  std::vector<llvm::Value *> phases;
+};
+
+void optimize(llvm::Module &module) {
+  llvm::LoopAnalysisManager loop_analyses;
+  llvm::FunctionAnalysisManager function_analyses;
+  llvm::CGSCCAnalysisManager cgscc_analyses;
+  llvm::ModuleAnalysisManager module_analyses;
+  llvm::PassBuilder passes;
+  passes.registerModuleAnalyses(module_analyses);
+  passes.registerCGSCCAnalyses(cgscc_analyses);
+  passes.registerFunctionAnalyses(function_analyses);
+  passes.registerLoopAnalyses(loop_analyses);
+  passes.crossRegisterProxies(loop_analyses, function_analyses, cgscc_analyses,
+                              module_analyses);
+  passes.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2)
+      .run(module, module_analyses);
+}
+
+// Runs on the Reclaimer thread. Publishes the kernel on success and leaves
+// the interpreter in charge on failure.
+void compile_kernel(const FusedGraphSpec &spec, FusedKernel &kernel) {
+  static std::once_flag native_target;
+  std::call_once(native_target, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit) {
+    std::cerr << "Failed to create JIT: " << llvm::toString(jit.takeError())
+              << std::endl;
+    return;
+  }
+
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto module = std::make_unique<llvm::Module>("fused_graph", *context);
+  module->setDataLayout((*jit)->getDataLayout());
+  module->setTargetTriple((*jit)->getTargetTriple().str());
+  KernelEmitter(spec, *context, *module).emit();
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    std::cerr << "Fused graph kernel failed verification" << std::endl;
+    return;
+  }
+  optimize(*module);
+
+  if (auto error = (*jit)->addIRModule(llvm::orc::ThreadSafeModule(
+          std::move(module), std::move(context)))) {
+    std::cerr << "Failed to add fused graph kernel: "
+              << llvm::toString(std::move(error)) << std::endl;
+    return;
+  }
+  auto symbol = (*jit)->lookup("fused_kernel");
+  if (!symbol) {
+    std::cerr << "Failed to compile fused graph kernel: "
+              << llvm::toString(symbol.takeError()) << std::endl;
+    return;
+  }
+  kernel.jit = std::move(*jit);
+  kernel.fn.store(reinterpret_cast<FusedKernelFn>(symbol->getAddress()),
+                  std::memory_order_release);
+}
+
+// Key for the kernel cache. The kernel reads every frequency, amplitude and
+// gain from the parameter slots, so only the kinds and wiring of the nodes
+// shape its code.
+std::string structure_key(const FusedGraphSpec &spec) {
+  std::string key;
+  for (const FusedNode &node : spec.nodes) {
+    key += std::to_string(static_cast<int>(node.kind));
+    for (unsigned input : node.inputs) {
+      key += "," + std::to_string(input);
+    }
+    key += ";";
+  }
+  for (unsigned output : spec.outputs) {
+    key += ">" + std::to_string(output);
+  }
+  return key;
+}
+
+// Kernels of the graphs alive or still compiling, so that the voices of a
+// polyphonic instance, and instances of the same type, compile only once
+std::mutex kernel_cache_mutex;
+std::map<std::string, std::weak_ptr<FusedKernel>> kernel_cache;
+
+std::shared_ptr<FusedKernel> acquire_kernel(const FusedGraphSpec &spec) {
+  const std::string key = structure_key(spec);
+  std::lock_guard<std::mutex> lock(kernel_cache_mutex);
+  if (auto kernel = kernel_cache[key].lock()) {
+    return kernel;
+  }
+  for (auto it = kernel_cache.begin(); it != kernel_cache.end();) {
+    it = it->second.expired() && it->first != key ? kernel_cache.erase(it)
+                                                  : std::next(it);
+  }
+  auto kernel = std::make_shared<FusedKernel>();
+  kernel_cache[key] = kernel;
+  // A full optimizing compile, kept off the realtime workers the audio
+  // callback fans out to and off the thread creating the DSP
+  Reclaimer::post(
+      [graph = spec, kernel] { compile_kernel(graph, *kernel); });
+  return kernel;
+}
+} // namespace
+
+FusedGraphDSP::FusedGraphDSP(FusedGraphSpec graph_spec)
+    : spec(std::move(graph_spec)) {
+  const size_t num_nodes = spec.nodes.size();
+  for (size_t n = 0; n < num_nodes; ++n) {
+    const FusedNode &node = spec.nodes[n];
+    size_t expected_inputs = node.inputs.size(); // Mix takes any number
+    if (is_oscillator(node.kind)) {
+      expected_inputs = 0;
+    } else if (node.kind == FusedNode::Kind::Gain) {
+      expected_inputs = 1;
+    }
+    if (node.inputs.size() != expected_inputs ||
+        std::any_of(node.inputs.begin(), node.inputs.end(),
+                    [n](unsigned input) { return input >= n; })) {
+      throw std::invalid_argument("FusedGraphDSP: bad inputs for node " +
+                                  node.name);
+    }
+  }
+  for (unsigned output : spec.outputs) {
+    if (output >= num_nodes) {
+      throw std::invalid_argument("FusedGraphDSP: bad output node");
+    }
+  }
+
+  const size_t num_slots = num_nodes * SLOTS_PER_NODE;
+  slot_values = std::make_unique<std::atomic<float>[]>(num_slots);
+  block_slots.assign(num_slots, 0.0f);
+  phases.assign(num_nodes, 0.0);
+  auto add_parameter = [&](size_t node, unsigned slot, const char *name,
+                           float min_value, float max_value, float value) {
+    const unsigned index = static_cast<unsigned>(node * SLOTS_PER_NODE + slot);
+    descriptors.push_back({static_cast<ParameterId>(descriptors.size()),
+                           spec.nodes[node].name + "/" + name,
+                           ParameterType::Float, min_value, max_value, value});
+    parameter_slots.push_back(index);
+    slot_values[index].store(value);
+  };
+  for (size_t n = 0; n < num_nodes; ++n) {
+    const FusedNode &node = spec.nodes[n];
+    if (is_oscillator(node.kind)) {
+      add_parameter(n, 0, "frequency", 20.0f, 20000.0f, node.value);
+      add_parameter(n, 1, "amplitude", 0.0f, 1.0f, node.amplitude);
+    } else if (node.kind == FusedNode::Kind::Gain) {
+      add_parameter(n, 0, "gain", 0.0f, 2.0f, node.value);
+    }
+  }
+
+  kernel = acquire_kernel(spec);
+}
+
+FusedGraphDSP::~FusedGraphDSP() = default;
+
+bool FusedGraphDSP::is_compiled() const {
+  return kernel->fn.load(std::memory_order_acquire) != nullptr;
+}
+
+void FusedGraphDSP::set_parameter(ParameterId id, const ParameterValue &value) {
+  if (id < parameter_slots.size()) {
+    const auto &descriptor = descriptors[id];
+    slot_values[parameter_slots[id]].store(
+        std::clamp(parameter_as_float(value), descriptor.min_value,
+                   descriptor.max_value),
+        std::memory_order_relaxed);
+  }
+}
+
+ParameterValue FusedGraphDSP::get_parameter(ParameterId id) const {
+  if (id >= parameter_slots.size()) {
+    throw std::runtime_error("Unknown parameter id: " + std::to_string(id));
+  }
+  return slot_values[parameter_slots[id]].load(std::memory_order_relaxed);
+}
+
+void FusedGraphDSP::prepare(double sample_rate, jack_nframes_t max_frames) {
+  inverse_sample_rate = 1.0 / sample_rate;
+  max_block = max_frames;
+  scratch.assign(spec.nodes.size() * static_cast<size_t>(max_frames), 0.0f);
+}
+
+void FusedGraphDSP::process_audio(jack_nframes_t nframes, float **,
+                                  float **outputs, double) {
+  for (size_t i = 0; i < block_slots.size(); ++i) {
+    block_slots[i] = slot_values[i].load(std::memory_order_relaxed);
+  }
+  if (FusedKernelFn fn = kernel->fn.load(std::memory_order_acquire)) {
+    fn(outputs, nframes, block_slots.data(), phases.data(),
+       inverse_sample_rate);
+  } else {
+    interpret(nframes, outputs);
+  }
+}
+
+// Reference path: one pass over the block per node, through scratch
+void FusedGraphDSP::interpret(jack_nframes_t nframes, float **outputs) {
+  using simd::vfloat;
+  constexpr jack_nframes_t width = vfloat::width;
+
+  for (size_t n = 0; n < spec.nodes.size(); ++n) {
+    const FusedNode &node = spec.nodes[n];
+    float *out = scratch.data() + n * max_block;
+    const float value = block_slots[n * SLOTS_PER_NODE];
+
+    if (node.kind == FusedNode::Kind::Gain) {
+      const float *in = scratch.data() + node.inputs[0] * max_block;
+      for (jack_nframes_t i = 0; i < nframes; ++i) {
+        out[i] = in[i] * value;
+      }
+      continue;
+    }
+    if (node.kind == FusedNode::Kind::Mix) {
+      std::fill_n(out, nframes, 0.0f);
+      for (unsigned input : node.inputs) {
+        simd::add_to(out, scratch.data() + input * max_block, nframes);
+      }
+      continue;
+    }
+
+    auto wave = [kind = node.kind](auto phase) {
+      switch (kind) {
+      case FusedNode::Kind::Sine:
+        return simd::sin_cycles(phase);
+      case FusedNode::Kind::Square:
+        return simd::square_cycles(phase);
+      default:
+        return simd::saw_cycles(phase);
+      }
+    };
+    const float amp = block_slots[n * SLOTS_PER_NODE + 1];
+    const double increment = value * inverse_sample_rate;
+    const vfloat lane_offsets = vfloat::ramp() * static_cast<float>(increment);
+    double &phase = phases[n];
+    jack_nframes_t i = 0;
+    for (; i + width <= nframes; i += width) {
+      const vfloat lane_phases =
+          vfloat(static_cast<float>(phase)) + lane_offsets;
+      (wave(lane_phases) * amp).store(out + i);
+      phase += increment * width;
+      phase -= std::floor(phase);
+    }
+    for (; i < nframes; ++i) {
+      out[i] = wave(static_cast<float>(phase)) * amp;
+      phase += increment;
+      phase -= std::floor(phase);
+    }
+  }
+
+  for (size_t k = 0; k < spec.outputs.size(); ++k) {
+    std::copy_n(scratch.data() + spec.outputs[k] * max_block, nframes,
+                outputs[k]);
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "dsp.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Graph of built-in nodes, described by value so it can be compiled
+struct FusedNode {
+  enum class Kind { Sine, Square, Saw, Gain, Mix };
+
+  Kind kind;
+  std::string name;
+  // Earlier nodes feeding this one: one for Gain, any number for Mix
+  std::vector<unsigned> inputs;
+  // Initial frequency for oscillators, gain for Gain
+  float value = DEFAULT_FREQUENCY;
+  // Initial amplitude for oscillators
+  float amplitude = DEFAULT_AMPLITUDE;
+};
+
+struct FusedGraphSpec {
+  // In evaluation order; a node may only read nodes before it
+  std::vector<FusedNode> nodes;
+  // Node played on each output channel
+  std::vector<unsigned> outputs;
+};
+
+struct FusedKernel;
+
+// DSP that runs a FusedGraphSpec as one LLVM-compiled function per block.
+//
+// The whole graph is emitted as a single vectorized loop: every node's
+// sample is computed in registers and only the outputs are stored, so there
+// are no virtual calls, intermediate buffers or per-node passes over the
+// block. Compilation runs on the Reclaimer thread, at normal priority, and
+// graphs of the same structure share one kernel. Until it finishes, or if
+// it fails, an interpreter renders the same graph node by node; the
+// compiled kernel takes over at the next block boundary and continues from
+// the same oscillator phases.
+class FusedGraphDSP : public DSP {
+public:
+  // Throws std::invalid_argument if a node reads a later node
+  explicit FusedGraphDSP(FusedGraphSpec spec);
+  ~FusedGraphDSP() override;
+
+  // True once the compiled kernel is in use
+  bool is_compiled() const;
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return descriptors;
+  }
+  void set_parameter(ParameterId id, const ParameterValue &value) override;
+  ParameterValue get_parameter(ParameterId id) const override;
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override;
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double sample_rate) override;
+  int get_num_inputs() const override { return 0; }
+  int get_num_outputs() const override {
+    return static_cast<int>(spec.outputs.size());
+  }
+
+  // Each node owns two parameter slots: frequency and amplitude for
+  // oscillators, gain for Gain
+  static constexpr unsigned SLOTS_PER_NODE = 2;
+
+private:
+  void interpret(jack_nframes_t nframes, float **outputs);
+
+  FusedGraphSpec spec;
+  std::vector<ParameterDescriptor> descriptors;
+  // Parameter slot behind each descriptor
+  std::vector<unsigned> parameter_slots;
+  std::unique_ptr<std::atomic<float>[]> slot_values;
+
+  // Audio thread state, shared with the compiled kernel
+  std::vector<float> block_slots;
+  std::vector<double> phases;
+
+  // Set by prepare
+  double inverse_sample_rate = 0.0;
+  // Interpreter scratch, one block per node
+  jack_nframes_t max_block = 0;
+  std::vector<float> scratch;
+
+  // Shared with the compile task, which may outlive this DSP, and with
+  // every FusedGraphDSP of the same structure
+  std::shared_ptr<FusedKernel> kernel;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "simd.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Half-band lowpass for 2x resampling, run as its two polyphase branches.
+//
+// Cut at a quarter of the higher rate, a half-band filter has every even
+// tap zero except the centre one, which is 1/2, and its odd taps come in
+// symmetric pairs. Upsampling therefore copies each input sample to an even
+// output and computes only the odd outputs from the pairs, and downsampling
+// applies the pairs to the even input samples and the centre tap to the odd
+// ones: either way, PAIRS multiply-adds per lower-rate sample. Both branches
+// vectorize across consecutive samples with unaligned loads.
+//
+// Windowed sinc with a Kaiser window: the passband is flat to 0.002 dB up
+// to 0.4 of the lower rate, and images and aliases above 0.6 of it are
+// 74 dB down.
+struct HalfBandFilter {
+  static constexpr size_t PAIRS = 12;
+  // Samples of history each branch keeps, at the lower rate
+  static constexpr size_t HISTORY = 2 * PAIRS;
+
+  // taps[j] is the coefficient of the filter taps 2j + 1 either side of the
+  // centre
+  std::array<float, PAIRS> taps;
+
+  static const HalfBandFilter &get() {
+    static const HalfBandFilter filter;
+    return filter;
+  }
+
+  // out[m] = sum_j taps[j] * (x[m + PAIRS - j] + x[m + PAIRS + 1 + j]) for m
+  // in [0, nframes): the odd branch, centred between x[m + PAIRS] and
+  // x[m + PAIRS + 1]
+  void odd_branch(const float *x, size_t nframes, float *out) const {
+    using simd::vfloat;
+    constexpr size_t width = vfloat::width;
+    size_t m = 0;
+    for (; m + width <= nframes; m += width) {
+      vfloat sum(0.0f);
+      for (size_t j = 0; j < PAIRS; ++j) {
+        sum = simd::mul_add(vfloat(taps[j]),
+                            vfloat::load(x + m + PAIRS - j) +
+                                vfloat::load(x + m + PAIRS + 1 + j),
+                            sum);
+      }
+      sum.store(out + m);
+    }
+    for (; m < nframes; ++m) {
+      float sum = 0.0f;
+      for (size_t j = 0; j < PAIRS; ++j) {
+        sum += taps[j] * (x[m + PAIRS - j] + x[m + PAIRS + 1 + j]);
+      }
+      out[m] = sum;
+    }
+  }
+
+private:
+  HalfBandFilter() {
+    constexpr double BETA = 7.5;
+    // Half the span of the nonzero taps, plus one so the outermost pair is
+    // not windowed to zero
+    const double half_span = 2.0 * PAIRS;
+    double sum = 0.0;
+    for (size_t j = 0; j < PAIRS; ++j) {
+      const double k = 2.0 * j + 1.0;
+      const double sinc = std::sin(M_PI * k / 2.0) / (M_PI * k);
+      const double r = k / half_span;
+      const double window = bessel_i0(BETA * std::sqrt(1.0 - r * r)) /
+                            bessel_i0(BETA);
+      taps[j] = static_cast<float>(sinc * window);
+      sum += 2.0 * sinc * window;
+    }
+    // Unity gain at DC: the pairs sum to the other half
+    for (float &tap : taps) {
+      tap = static_cast<float>(tap * 0.5 / sum);
+    }
+  }
+
+  // Modified Bessel function of the first kind, order 0, by its series
+  static double bessel_i0(double x) {
+    double term = 1.0;
+    double sum = 1.0;
+    for (int k = 1; term > 1e-12 * sum; ++k) {
+      const double ratio = x / (2.0 * k);
+      term *= ratio * ratio;
+      sum += term;
+    }
+    return sum;
+  }
+};
+
+// Doubles the rate of one channel. Delays by PAIRS lower-rate samples.
+class HalfBandUpsampler {
+public:
+  // Outside the audio thread; sizes for blocks of up to max_frames input
+  // samples and clears the history
+  void prepare(size_t max_frames) {
+    history.assign(HalfBandFilter::HISTORY + max_frames, 0.0f);
+    odd.assign(max_frames, 0.0f);
+  }
+
+  // Writes 2 * nframes samples to out
+  void process(const float *in, size_t nframes, float *out) {
+    constexpr size_t HISTORY = HalfBandFilter::HISTORY;
+    float *x = history.data();
+    std::copy(in, in + nframes, x + HISTORY);
+    HalfBandFilter::get().odd_branch(x, nframes, odd.data());
+    // Zero-stuffing doubles the gain the filter has to make up
+    for (size_t m = 0; m < nframes; ++m) {
+      out[2 * m] = x[m + HalfBandFilter::PAIRS];
+      out[2 * m + 1] = 2.0f * odd[m];
+    }
+    std::copy(x + nframes, x + nframes + HISTORY, x);
+  }
+
+private:
+  std::vector<float> history;
+  std::vector<float> odd;
+};
+
+// Halves the rate of one channel. Delays by PAIRS - 1/2 lower-rate samples.
+class HalfBandDownsampler {
+public:
+  // Outside the audio thread; sizes for blocks of up to max_frames output
+  // samples and clears the history
+  void prepare(size_t max_frames) {
+    even.assign(HalfBandFilter::HISTORY + max_frames, 0.0f);
+    odd.assign(HalfBandFilter::HISTORY + max_frames, 0.0f);
+  }
+
+  // Reads 2 * nframes samples from in
+  void process(const float *in, size_t nframes, float *out) {
+    constexpr size_t HISTORY = HalfBandFilter::HISTORY;
+    float *e = even.data();
+    float *o = odd.data();
+    for (size_t m = 0; m < nframes; ++m) {
+      e[HISTORY + m] = in[2 * m];
+      o[HISTORY + m] = in[2 * m + 1];
+    }
+    HalfBandFilter::get().odd_branch(e, nframes, out);
+    for (size_t m = 0; m < nframes; ++m) {
+      out[m] += 0.5f * o[m + HalfBandFilter::PAIRS];
+    }
+    std::copy(e + nframes, e + nframes + HISTORY, e);
+    std::copy(o + nframes, o + nframes + HISTORY, o);
+  }
+
+private:
+  std::vector<float> even;
+  std::vector<float> odd;
+};
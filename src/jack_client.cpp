@@ -0,0 +1,439 @@
+#include "jack_client.h"
+
+#include "reclaimer.h"
+#include "rt.h"
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <jack/midiport.h>
+#include <sched.h>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Union of the ports' latency ranges in mode, or none without ports
+jack_latency_range_t
+combined_latency(const std::vector<jack_port_t *> &ports,
+                 jack_latency_callback_mode_t mode) {
+  if (ports.empty()) {
+    return {0, 0};
+  }
+  jack_latency_range_t combined{~jack_nframes_t{0}, 0};
+  for (jack_port_t *port : ports) {
+    jack_latency_range_t range;
+    jack_port_get_latency_range(port, mode, &range);
+    combined.min = std::min(combined.min, range.min);
+    combined.max = std::max(combined.max, range.max);
+  }
+  return combined;
+}
+
+} // namespace
+
+JackClient::Instance::Instance(JackClient &owner, std::string name,
+                               std::unique_ptr<DSP> dsp,
+                               const std::string &port_prefix)
+    : owner(owner), name(std::move(name)), port_prefix(port_prefix),
+      dsp(std::make_unique<std::unique_ptr<DSP>>(std::move(dsp))) {
+  const int num_inputs = get_dsp()->get_num_inputs();
+  const int num_outputs = get_dsp()->get_num_outputs();
+
+  input_ports.reserve(num_inputs);   // Reserve memory upfront
+  output_ports.reserve(num_outputs); // Reserve memory upfront
+
+  for (int i = 0; i < num_inputs; ++i) {
+    input_ports.push_back(jack_port_register(
+        owner.client, (port_prefix + "input" + std::to_string(i)).c_str(),
+        JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0));
+  }
+
+  for (int i = 0; i < num_outputs; ++i) {
+    output_ports.push_back(jack_port_register(
+        owner.client, (port_prefix + "output" + std::to_string(i)).c_str(),
+        JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0));
+  }
+
+  if (get_dsp()->receives_midi()) {
+    midi_port = jack_port_register(owner.client,
+                                   (port_prefix + "midi_in").c_str(),
+                                   JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+  }
+
+  input_buffers.assign(num_inputs, nullptr);
+  output_buffers.assign(num_outputs, nullptr);
+  events.reserve(MAX_EVENTS_PER_PERIOD);
+}
+
+JackClient::Instance::~Instance() {
+  if (!owner.client) {
+    return;
+  }
+  for (jack_port_t *port : input_ports) {
+    jack_port_unregister(owner.client, port);
+  }
+  for (jack_port_t *port : output_ports) {
+    jack_port_unregister(owner.client, port);
+  }
+  if (midi_port) {
+    jack_port_unregister(owner.client, midi_port);
+  }
+}
+
+JackClient::JackClient(const char *client_name) : name(client_name) {
+  client = jack_client_open(name.c_str(), JackNullOption, nullptr);
+  if (!client) {
+    throw std::runtime_error("Failed to open JACK client");
+  }
+  // Without JackUseExactName the server renames a client whose name is
+  // taken; port names are built from the name it got
+  name = jack_get_client_name(client);
+
+  if (jack_set_process_callback(client, process, this) != 0) {
+    jack_client_close(client);
+    throw std::runtime_error("Failed to set JACK process callback");
+  }
+
+  if (jack_set_buffer_size_callback(client, buffer_size_changed, this) != 0) {
+    jack_client_close(client);
+    throw std::runtime_error("Failed to set JACK buffer size callback");
+  }
+
+  if (jack_set_sample_rate_callback(client, sample_rate_changed, this) != 0) {
+    jack_client_close(client);
+    throw std::runtime_error("Failed to set JACK sample rate callback");
+  }
+  sample_rate = jack_get_sample_rate(client);
+  buffer_size = jack_get_buffer_size(client);
+
+  if (jack_set_xrun_callback(client, xrun, this) != 0) {
+    jack_client_close(client);
+    throw std::runtime_error("Failed to set JACK xrun callback");
+  }
+
+  if (jack_set_latency_callback(client, latency, this) != 0) {
+    jack_client_close(client);
+    throw std::runtime_error("Failed to set JACK latency callback");
+  }
+
+  jack_on_shutdown(client, jack_shutdown, this);
+
+  if (jack_activate(client)) {
+    jack_client_close(client);
+    throw std::runtime_error("Failed to activate JACK client");
+  }
+}
+
+JackClient::JackClient(const char *client_name, std::unique_ptr<DSP> dsp,
+                       DSPSource source)
+    : JackClient(client_name) {
+  add_instance(name, std::move(dsp), "", std::move(source));
+}
+
+JackClient::~JackClient() {
+  // Instances handed to the Reclaimer earlier still unregister their ports
+  // through this client
+  Reclaimer::drain();
+  if (client) {
+    jack_deactivate(client);
+  }
+  // The process callback has stopped, so every instance can go now, before
+  // the client they belong to
+  instances.clear();
+  active_instances.publish(std::make_unique<InstanceList>());
+  active_instances.collect_all();
+  if (client) {
+    jack_client_close(client);
+  }
+}
+
+void JackClient::add_instance(const std::string &instance_name,
+                              std::unique_ptr<DSP> dsp,
+                              const std::string &port_prefix,
+                              DSPSource source) {
+  auto instance = std::make_shared<Instance>(*this, instance_name,
+                                             std::move(dsp), port_prefix);
+  instance->source = std::move(source);
+  const jack_nframes_t latency = instance->get_dsp()->get_latency();
+  {
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    instance->get_dsp()->prepare(sample_rate, buffer_size);
+    instance->parameters.reset(*instance->get_dsp(), ++parameter_version);
+    instances.push_back(std::move(instance));
+  }
+  publish_instances();
+  // Outside the lock, which the latency callback takes
+  if (latency != 0 && client) {
+    jack_recompute_total_latencies(client);
+  }
+}
+
+bool JackClient::remove_instance(const std::string &instance_name) {
+  {
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    auto it = std::find_if(instances.begin(), instances.end(),
+                           [&](const std::shared_ptr<Instance> &instance) {
+                             return instance->name == instance_name;
+                           });
+    if (it == instances.end()) {
+      return false;
+    }
+    instances.erase(it);
+  }
+  // The retired list keeps the instance alive until the process callback
+  // has picked up the new one
+  publish_instances();
+  return true;
+}
+
+bool JackClient::replace_dsp(const std::string &instance_name,
+                             std::unique_ptr<DSP> dsp, DSPSource source) {
+  bool latency_changed = false;
+  {
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    auto it = std::find_if(instances.begin(), instances.end(),
+                           [&](const std::shared_ptr<Instance> &instance) {
+                             return instance->name == instance_name;
+                           });
+    if (it == instances.end()) {
+      return false;
+    }
+    Instance &instance = **it;
+    const DSP &current = *instance.get_dsp();
+    if (dsp->get_num_inputs() != current.get_num_inputs() ||
+        dsp->get_num_outputs() != current.get_num_outputs() ||
+        dsp->receives_midi() != current.receives_midi()) {
+      throw std::invalid_argument("Replacement DSP for " + instance_name +
+                                  " needs different ports");
+    }
+    latency_changed = dsp->get_latency() != current.get_latency();
+    dsp->prepare(sample_rate, buffer_size);
+    // The new DSP starts from its own values; edits staged for the old one
+    // are dropped
+    instance.parameters.reset(*dsp, ++parameter_version);
+    instance.source = std::move(source);
+    instance.dsp.publish(
+        std::make_unique<std::unique_ptr<DSP>>(std::move(dsp)),
+        Reclaimer::dispose<std::unique_ptr<DSP>>);
+  }
+  // Outside the lock, which the latency callback takes
+  if (latency_changed && client) {
+    jack_recompute_total_latencies(client);
+  }
+  return true;
+}
+
+JackClient::Instance *
+JackClient::find_instance(const std::string &instance_name) const {
+  for (const auto &instance : instances) {
+    if (instance->name == instance_name) {
+      return instance.get();
+    }
+  }
+  return nullptr;
+}
+
+void JackClient::collect_garbage() {
+  active_instances.collect(Reclaimer::dispose<InstanceList>);
+  for (const auto &instance : instances) {
+    instance->dsp.collect(Reclaimer::dispose<std::unique_ptr<DSP>>);
+  }
+}
+
+void JackClient::set_parameter(Instance &instance, ParameterId id,
+                               const ParameterValue &value) {
+  instance.parameters.set(id, value);
+}
+
+uint64_t JackClient::commit_parameters() {
+  bool changed = false;
+  for (const auto &instance : instances) {
+    if (instance->parameters.has_staged()) {
+      if (!changed) {
+        changed = true;
+        ++parameter_version;
+      }
+      instance->parameters.commit(*instance->get_dsp(), parameter_version);
+    }
+    // Retries what a full queue turned away, here or in an earlier commit
+    instance->get_dsp()->flush_parameters();
+  }
+  return parameter_version;
+}
+
+void JackClient::set_tap_enabled(bool enabled) {
+  if (enabled && !tap) {
+    tap = std::make_unique<AudioTap>();
+  }
+  tap_enabled.store(enabled, std::memory_order_release);
+}
+
+bool JackClient::connect(const std::string &source,
+                         const std::string &destination) {
+  if (!client) {
+    return false;
+  }
+  const int status = jack_connect(client, source.c_str(), destination.c_str());
+  return status == 0 || status == EEXIST;
+}
+
+void JackClient::publish_instances() {
+  active_instances.publish(std::make_unique<InstanceList>(instances),
+                           Reclaimer::dispose<InstanceList>);
+}
+
+int JackClient::process(jack_nframes_t nframes, void *arg) {
+  rt::ProcessScope scope;
+  // Set per callback rather than once, as JACK owns the thread; costs two
+  // control register writes a period
+  rt::DenormalGuard denormals;
+  const auto start = BlockProfiler::clock::now();
+  auto *self = static_cast<JackClient *>(arg);
+  self->process_cpu.store(sched_getcpu(), std::memory_order_relaxed);
+  self->process_audio(nframes);
+  self->callback_profiler.record(start, BlockProfiler::clock::now());
+  return 0;
+}
+
+int JackClient::xrun(void *arg) {
+  auto *self = static_cast<JackClient *>(arg);
+  self->xrun_count.fetch_add(1, std::memory_order_relaxed);
+  self->xrun_times.try_push(jack_get_time());
+  return 0;
+}
+
+// Latency flows through every instance from its inputs to its outputs:
+// capture latency downstream from what feeds the inputs, playback latency
+// upstream from what the outputs feed. Runs on JACK's notification thread.
+void JackClient::latency(jack_latency_callback_mode_t mode, void *arg) {
+  auto *self = static_cast<JackClient *>(arg);
+  std::lock_guard<std::mutex> lock(self->instances_mutex);
+  for (const auto &instance : self->instances) {
+    std::vector<jack_port_t *> inputs = instance->input_ports;
+    if (instance->midi_port) {
+      inputs.push_back(instance->midi_port);
+    }
+    const bool capture = mode == JackCaptureLatency;
+    jack_latency_range_t range =
+        combined_latency(capture ? inputs : instance->output_ports, mode);
+    const jack_nframes_t latency = instance->get_dsp()->get_latency();
+    range.min += latency;
+    range.max += latency;
+    for (jack_port_t *port : capture ? instance->output_ports : inputs) {
+      jack_port_set_latency_range(port, mode, &range);
+    }
+  }
+}
+
+bool JackClient::update_meters() {
+  bool changed = callback_profiler.update();
+  for (const auto &instance : instances) {
+    changed |= instance->profiler.update();
+    const VoiceUsage before = instance->telemetry.get().voices;
+    if (instance->telemetry.update()) {
+      const VoiceUsage &after = instance->telemetry.get().voices;
+      changed |= after.active != before.active || after.total != before.total;
+    }
+  }
+  if (tap) {
+    changed |= tap_meter.update(*tap);
+  }
+  constexpr size_t MAX_RECENT_XRUNS = 8;
+  changed |= xrun_times.consume_all([this](jack_time_t time) {
+    recent_xruns.push_back(time);
+    if (recent_xruns.size() > MAX_RECENT_XRUNS) {
+      recent_xruns.pop_front();
+    }
+  }) > 0;
+  return changed;
+}
+
+// JACK stops processing while the buffer size or sample rate changes, so
+// the DSPs may reallocate their scratch memory and tables here
+int JackClient::buffer_size_changed(jack_nframes_t nframes, void *arg) {
+  auto *self = static_cast<JackClient *>(arg);
+  std::lock_guard<std::mutex> lock(self->instances_mutex);
+  if (nframes != self->buffer_size) {
+    self->buffer_size = nframes;
+    self->prepare_instances();
+  }
+  return 0;
+}
+
+int JackClient::sample_rate_changed(jack_nframes_t rate, void *arg) {
+  auto *self = static_cast<JackClient *>(arg);
+  std::lock_guard<std::mutex> lock(self->instances_mutex);
+  if (rate != self->sample_rate) {
+    self->sample_rate = rate;
+    self->prepare_instances();
+  }
+  return 0;
+}
+
+void JackClient::prepare_instances() {
+  for (const auto &instance : instances) {
+    instance->get_dsp()->prepare(sample_rate, buffer_size);
+  }
+}
+
+void JackClient::jack_shutdown(void *arg) {
+  auto *self = static_cast<JackClient *>(arg);
+  self->client = nullptr;
+  std::cerr << "JACK client has been shut down" << std::endl;
+}
+
+void JackClient::process_audio(jack_nframes_t nframes) {
+  const double rate = sample_rate.load(std::memory_order_relaxed);
+  AudioTap *const active_tap =
+      tap_enabled.load(std::memory_order_acquire) ? tap.get() : nullptr;
+  if (active_tap) {
+    active_tap->begin_period(nframes);
+  }
+
+  for (const auto &instance : *active_instances.read()) {
+    for (size_t i = 0; i < instance->input_ports.size(); ++i) {
+      instance->input_buffers[i] = static_cast<float *>(
+          jack_port_get_buffer(instance->input_ports[i], nframes));
+    }
+
+    for (size_t i = 0; i < instance->output_ports.size(); ++i) {
+      instance->output_buffers[i] = static_cast<float *>(
+          jack_port_get_buffer(instance->output_ports[i], nframes));
+    }
+
+    // JACK delivers a port's events sorted by time
+    instance->events.clear();
+    if (instance->midi_port) {
+      void *midi = jack_port_get_buffer(instance->midi_port, nframes);
+      const uint32_t count = jack_midi_get_event_count(midi);
+      for (uint32_t i = 0; i < count && i < MAX_EVENTS_PER_PERIOD; ++i) {
+        jack_midi_event_t raw;
+        MidiEvent event;
+        if (jack_midi_event_get(&raw, midi, i) == 0 &&
+            decode_midi_message(raw.buffer, raw.size, raw.time, event)) {
+          instance->events.push_back(event);
+        }
+      }
+    }
+
+    // process_events advances the buffer pointers past the block
+    const float *const tapped =
+        instance->output_buffers.empty() ? nullptr
+                                         : instance->output_buffers[0];
+    DSP *dsp = instance->dsp.read()->get();
+    const auto start = BlockProfiler::clock::now();
+    dsp->process_events(nframes, instance->input_buffers.data(),
+                                  instance->output_buffers.data(), rate,
+                                  instance->events.data(),
+                                  instance->events.size());
+    instance->profiler.record(start, BlockProfiler::clock::now());
+    instance->telemetry.back().voices = dsp->get_voice_usage();
+    instance->telemetry.publish();
+    if (active_tap && tapped) {
+      active_tap->mix(tapped);
+    }
+  }
+  if (active_tap) {
+    active_tap->end_period();
+  }
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "audio_tap.h"
+#include "dsp.h"
+#include "parameter_store.h"
+#include "profiler.h"
+#include "rcu_cell.h"
+#include "spsc_queue.h"
+#include "telemetry.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <jack/jack.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// How an instance's DSP was made, so a saved session can make it again:
+// the DSPFactory type, voice count and oversampling factor given to
+// create_instance_dsp. An empty type means unknown.
+struct DSPSource {
+  std::string type;
+  int voices = 0;
+  int oversampling = 1;
+};
+
+// JackClient class to handle generic DSPs
+//
+// A client hosts any number of DSP instances, each with its own ports, and
+// runs all of them from a single process callback. Hosting many instances
+// in one client saves jackd a process-thread wakeup and context switch per
+// instance every period. The instance list is swapped with an RcuCell, so
+// instances come and go without the process callback ever locking.
+class JackClient {
+public:
+  // Meter values of one instance's last period
+  struct Telemetry {
+    VoiceUsage voices;
+  };
+
+  struct Instance {
+    Instance(JackClient &owner, std::string name, std::unique_ptr<DSP> dsp,
+             const std::string &port_prefix);
+    ~Instance();
+
+    // Control side: the DSP published last
+    DSP *get_dsp() const { return dsp.get().get(); }
+
+    JackClient &owner;
+    std::string name;
+    std::string port_prefix;
+    DSPSource source; // Control side
+    // Swapped by replace_dsp; the process callback is the reader
+    RcuCell<std::unique_ptr<DSP>> dsp;
+    std::vector<jack_port_t *> input_ports;
+    std::vector<jack_port_t *> output_ports;
+    // Registered only for DSPs that receive MIDI
+    jack_port_t *midi_port = nullptr;
+    // Port buffer pointers and the decoded events of the current period,
+    // sized once so the process callback never allocates
+    std::vector<float *> input_buffers;
+    std::vector<float *> output_buffers;
+    std::vector<MidiEvent> events;
+    // Time spent in the DSP per period
+    BlockProfiler profiler;
+    // Published by the process callback every period
+    TelemetryBuffer<Telemetry> telemetry;
+    // Control thread's view of the DSP's parameters; see set_parameter
+    ParameterStore parameters;
+  };
+  using InstanceList = std::vector<std::shared_ptr<Instance>>;
+
+  // Opens a client with no instances; see add_instance
+  explicit JackClient(const char *client_name);
+  // Opens a client hosting one DSP on ports "input0", "output0", ...
+  JackClient(const char *client_name, std::unique_ptr<DSP> dsp,
+             DSPSource source = DSPSource{});
+  ~JackClient();
+
+  // Control thread only. Registers the instance's ports as
+  // "<port_prefix>input0", ..., plus "<port_prefix>midi_in" if the DSP
+  // receives MIDI, and starts processing it next period. The DSP's
+  // get_latency() is reported to JACK as the ports' latency.
+  void add_instance(const std::string &instance_name, std::unique_ptr<DSP> dsp,
+                    const std::string &port_prefix,
+                    DSPSource source = DSPSource{});
+  // Control thread only. Stops processing the instance; its ports are
+  // unregistered once the process callback has let go of it.
+  bool remove_instance(const std::string &instance_name);
+  // Control thread only. Swaps the instance's DSP at the next period without
+  // touching its ports; the old DSP is destroyed on the Reclaimer thread.
+  // Returns false if there is no such instance and throws
+  // std::invalid_argument if the new DSP needs different ports.
+  bool replace_dsp(const std::string &instance_name, std::unique_ptr<DSP> dsp,
+                   DSPSource source = DSPSource{});
+  // Control thread only. Hands instances and DSPs the process callback no
+  // longer sees to the Reclaimer; call periodically.
+  void collect_garbage();
+
+  // Control thread only. Stages a parameter change. Changes staged
+  // between two commit_parameters() calls are coalesced per parameter and
+  // reach the DSPs together.
+  void set_parameter(Instance &instance, ParameterId id,
+                     const ParameterValue &value);
+  // Control thread only. Hands the staged changes to the DSPs, advancing
+  // the parameter version once if there were any; call once per GUI frame
+  // or control batch. Also retries changes an earlier commit could not
+  // queue. Returns the current version.
+  uint64_t commit_parameters();
+  // Control thread only. Bumped by every commit that changed something and
+  // by every instance added or DSP replaced. A reader in sync at version v
+  // catches up with each instance's parameters.for_each_changed_since(v).
+  uint64_t get_parameter_version() const { return parameter_version; }
+
+  // Connects two ports by full name, "client:port". Returns true if they
+  // are connected afterwards, including when they already were.
+  bool connect(const std::string &source, const std::string &destination);
+
+  // Control thread only. Mixes the first output of every instance into an
+  // AudioTap each period, drained by update_meters into get_tap_meter().
+  // The tap is allocated on first use and kept, so the process callback
+  // never sees it go away.
+  void set_tap_enabled(bool enabled);
+  bool is_tap_enabled() const {
+    return tap_enabled.load(std::memory_order_relaxed);
+  }
+  // Control thread only; nullptr until the tap is first enabled
+  AudioTap *get_tap() const { return tap.get(); }
+  const TapMeter &get_tap_meter() const { return tap_meter; }
+
+  // Control thread only
+  const InstanceList &get_instances() const { return instances; }
+  // Control thread only. The instance named instance_name, or nullptr.
+  Instance *find_instance(const std::string &instance_name) const;
+  const char *get_name() const { return name.c_str(); }
+  // CPU the process callback last ran on, or -1 before the first period
+  int get_process_cpu() const {
+    return process_cpu.load(std::memory_order_relaxed);
+  }
+  // Control thread only. Drains the profilers, the xrun log, the instances'
+  // telemetry and the audio tap; call before reading them. Returns true if
+  // any of them changed since the last call.
+  bool update_meters();
+  // Control thread only. Whole process callback, across all instances.
+  const BlockProfiler &get_callback_profiler() const {
+    return callback_profiler;
+  }
+  uint64_t get_xrun_count() const {
+    return xrun_count.load(std::memory_order_relaxed);
+  }
+  // Control thread only. jack_get_time() of the latest xruns, newest last.
+  const std::deque<jack_time_t> &get_recent_xruns() const {
+    return recent_xruns;
+  }
+  // JACK's DSP load estimate for the whole graph, in percent
+  float get_cpu_load() const { return client ? jack_cpu_load(client) : 0.0f; }
+  // Length of one period, the budget every block must fit in
+  double get_period_us() const {
+    const double rate = sample_rate.load(std::memory_order_relaxed);
+    return rate > 0.0 ? buffer_size.load(std::memory_order_relaxed) * 1e6 / rate
+                      : 0.0;
+  }
+
+  // SCHED_FIFO priority of the JACK process thread, or 0 if not realtime
+  int get_realtime_priority() const {
+    return client && jack_is_realtime(client)
+               ? jack_client_real_time_priority(client)
+               : 0;
+  }
+
+private:
+  // Events past this many in one period are dropped
+  static constexpr size_t MAX_EVENTS_PER_PERIOD = 512;
+
+  static int process(jack_nframes_t nframes, void *arg);
+  static int buffer_size_changed(jack_nframes_t nframes, void *arg);
+  static int sample_rate_changed(jack_nframes_t rate, void *arg);
+  static int xrun(void *arg);
+  static void latency(jack_latency_callback_mode_t mode, void *arg);
+  static void jack_shutdown(void *arg);
+
+  void process_audio(jack_nframes_t nframes);
+  void publish_instances();
+  // Calls prepare on every instance with the cached engine state; the
+  // caller holds instances_mutex
+  void prepare_instances();
+
+  jack_client_t *client = nullptr;
+  std::string name;
+  // Control-side list. The mutex only orders it against the buffer size
+  // callback; the process callback reads active_instances instead.
+  InstanceList instances;
+  std::mutex instances_mutex;
+  uint64_t parameter_version = 0;
+  RcuCell<InstanceList> active_instances;
+  std::atomic<int> process_cpu{-1};
+  // Engine state cached from JACK's callbacks, so the process callback does
+  // not query the server every period
+  std::atomic<double> sample_rate{0.0};
+  std::atomic<jack_nframes_t> buffer_size{0};
+
+  BlockProfiler callback_profiler;
+  // Written by JACK's xrun callback, drained by update_meters
+  std::atomic<uint64_t> xrun_count{0};
+  SPSCQueue<jack_time_t, 64> xrun_times;
+  std::deque<jack_time_t> recent_xruns;
+
+  // Published to the process callback by tap_enabled
+  std::unique_ptr<AudioTap> tap;
+  std::atomic<bool> tap_enabled{false};
+  TapMeter tap_meter;
+};
\ No newline at end of file
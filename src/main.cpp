@@ -1,493 +1,374 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "dsp_factory.h"
+#include "jack_client.h"
+#include "oversampled_dsp.h"
+#include "plugin_loader.h"
+#include "polyphonic_dsp.h"
+#include "reclaimer.h"
+#include "rt_alloc_check.h"
+#include "session.h"
+#include "thread_manager.h"
 #include <GL/gl.h>
 #include <GLFW/glfw3.h>
-#include <atomic>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <cmath>
-#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <functional>
+#include <fstream>
+#include <future>
 #include <iostream>
-#include <jack/jack.h>
 #include <memory>
-#include <mutex>
-#include <queue>
-#include <stdexcept>
 #include <string>
 #include <thread>
-#include <unordered_map>
 #include <variant>
 #include <vector>
 
-// Constants
-constexpr double TWO_PI = 2.0 * M_PI;
-constexpr float DEFAULT_FREQUENCY = 440.0f;
-constexpr float DEFAULT_AMPLITUDE = 0.5f;
-
 // Error callback function for GLFW
 void glfw_error_callback(int error, const char *description) noexcept {
   std::fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
-// Abstract DSP base class defining the interface
-class DSP {
-public:
-  virtual ~DSP() = default;
-
-  virtual void process_audio(jack_nframes_t nframes, float **inputs,
-                             float **outputs, double sample_rate) = 0;
-  virtual int get_num_inputs() const = 0;
-  virtual int get_num_outputs() const = 0;
-  virtual void
-  set_parameter(const std::string &name,
-                const std::variant<float, int, std::string> &value) = 0;
-  virtual std::variant<float, int, std::string>
-  get_parameter(const std::string &name) const = 0;
-  virtual std::vector<std::string> get_parameter_names() const = 0;
-};
-
-
-class Oscillator : public DSP {
-public:
-  Oscillator()
-      : phase(0.0), frequency(DEFAULT_FREQUENCY), amplitude(DEFAULT_AMPLITUDE) {}
-
-  void set_parameter(const std::string &name,
-                     const std::variant<float, int, std::string> &value) override {
-    if (name == "frequency") {
-      frequency.store(std::get<float>(value));
-    } else if (name == "amplitude") {
-      amplitude.store(std::get<float>(value));
-    }
-  }
-
-  std::variant<float, int, std::string> get_parameter(const std::string &name) const override {
-    if (name == "frequency") {
-      return static_cast<float>(frequency.load());
-    } else if (name == "amplitude") {
-      return static_cast<float>(amplitude.load());
-    }
-    throw std::runtime_error("Unknown parameter: " + name);
-  }
-
-  std::vector<std::string> get_parameter_names() const override {
-    return {"frequency", "amplitude"};
-  }
-
-  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
-                     double sample_rate) override {
-    double phase_increment = TWO_PI * frequency.load() / sample_rate;
-    float amp = amplitude.load();
-    double local_phase = phase;
-
-    for (jack_nframes_t i = 0; i < nframes; ++i) {
-      outputs[0][i] = amp * generate_wave(local_phase);
-      local_phase += phase_increment;
-      if (local_phase >= TWO_PI) {
-        local_phase -= TWO_PI;
+// Render GUI for one DSP instance. Parameter edits are staged on the
+// client and committed once per frame; meters come from the telemetry.
+void render_dsp_gui(JackClient *client, JackClient::Instance &instance) {
+  DSP *dsp = instance.get_dsp();
+  const JackClient::Telemetry &telemetry = instance.telemetry.get();
+  ImGui::Begin(instance.name.c_str());
+  ImGui::Text("Simple DSP");
+  for (const auto &descriptor : dsp->get_parameter_descriptors()) {
+    const char *label = descriptor.name.c_str();
+    auto value = instance.parameters.get(descriptor.id);
+    if (descriptor.type == ParameterType::Float &&
+        std::holds_alternative<float>(value)) {
+      float fvalue = std::get<float>(value);
+      if (ImGui::SliderFloat(label, &fvalue, descriptor.min_value,
+                             descriptor.max_value)) {
+        client->set_parameter(instance, descriptor.id, fvalue);
+      }
+    } else if (descriptor.type == ParameterType::Int &&
+               std::holds_alternative<int>(value)) {
+      int ivalue = std::get<int>(value);
+      if (ImGui::SliderInt(label, &ivalue,
+                           static_cast<int>(descriptor.min_value),
+                           static_cast<int>(descriptor.max_value))) {
+        client->set_parameter(instance, descriptor.id, ivalue);
+      }
+    } else if (std::holds_alternative<std::string>(value)) {
+      const std::string &svalue = std::get<std::string>(value);
+      char buffer[128];
+      std::strncpy(buffer, svalue.c_str(), sizeof(buffer));
+      buffer[sizeof(buffer) - 1] = '\0'; // Ensure null termination
+      if (ImGui::InputText(label, buffer, sizeof(buffer))) {
+        client->set_parameter(instance, descriptor.id,
+                              std::string(buffer));
       }
     }
-
-    phase = local_phase;
-  }
-
-  int get_num_inputs() const override { return 0; }
-  int get_num_outputs() const override { return 1; }
-
-protected:
-  virtual float generate_wave(double phase) const = 0;
-
-private:
-  double phase;
-  std::atomic<double> frequency;
-  std::atomic<float> amplitude;
-};
-
-class SinOsc : public Oscillator {
-protected:
-  float generate_wave(double phase) const override {
-    return std::sin(phase);
-  }
-};
-
-class SquareWave : public Oscillator {
-protected:
-  float generate_wave(double phase) const override {
-    return (std::sin(phase) > 0) ? 1.0f : -1.0f;
-  }
-};
-
-class SawWave : public Oscillator {
-protected:
-  float generate_wave(double phase) const override {
-    return 2.0f * (phase / TWO_PI - std::floor(phase / TWO_PI + 0.5));
-  }
-};
-
-// Thread-safe DSP factory class
-class DSPFactory {
-public:
-  using DSPCreator = std::function<std::unique_ptr<DSP>()>;
-
-  static DSPFactory &instance() {
-    static DSPFactory instance;
-    return instance;
-  }
-
-  void register_dsp(const std::string &name, DSPCreator creator) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    creators[name] = std::move(creator);
-  }
-
-  std::unique_ptr<DSP> create_dsp(const std::string &name) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = creators.find(name);
-    if (it != creators.end()) {
-      return it->second();
-    }
-    throw std::runtime_error("Unknown DSP type: " + name);
   }
 
-  std::vector<std::string> get_registered_dsps() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<std::string> dsp_names;
-    for (const auto &[key, _] : creators) {
-      dsp_names.push_back(key);
+  // Note controls, shared by all windows
+  static int note = 69;
+  static float velocity = 0.8f;
+  ImGui::Separator();
+  ImGui::SliderInt("note", &note, 0, 127);
+  ImGui::SliderFloat("velocity", &velocity, 0.0f, 1.0f);
+  if (ImGui::Button("Note On")) {
+    dsp->note_on(note, velocity);
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Note Off")) {
+    dsp->note_off(note);
+  }
+
+  if (telemetry.voices.total > 0) {
+    ImGui::Text("%u / %u voices active", telemetry.voices.active,
+                telemetry.voices.total);
+  }
+  DSP *inner = dsp;
+  if (auto *oversampled = dynamic_cast<OversampledDSP *>(dsp)) {
+    ImGui::Text("Oversampled %dx, %u frames latency",
+                oversampled->get_factor(), oversampled->get_latency());
+    inner = &oversampled->get_dsp();
+  }
+  if (auto *poly = dynamic_cast<PolyphonicDSP *>(inner)) {
+    static const char *const policies[] = {"Steal oldest", "Steal quietest"};
+    int policy = static_cast<int>(poly->get_steal_policy());
+    if (ImGui::Combo("voice stealing", &policy, policies,
+                     IM_ARRAYSIZE(policies))) {
+      poly->set_steal_policy(
+          static_cast<PolyphonicDSP::StealPolicy>(policy));
     }
-    return dsp_names;
   }
+  ImGui::End();
+}
 
-private:
-  DSPFactory() = default;
-  mutable std::mutex mutex_;
-  std::unordered_map<std::string, DSPCreator> creators;
-};
-
-// Polyphonic DSP Class
-class PolyphonicDSP : public DSP {
-public:
-  PolyphonicDSP(std::function<std::unique_ptr<DSP>()> create_dsp,
-                int num_voices)
-      : create_dsp(std::move(create_dsp)), voices(num_voices) {
-    for (auto &voice : voices) {
-      voice = this->create_dsp();
-    }
+// Render GUI for every instance hosted by a JackClient
+void render_client_gui(JackClient *client) {
+  for (const auto &instance : client->get_instances()) {
+    render_dsp_gui(client, *instance);
   }
+}
 
-  void
-  set_parameter(const std::string &name,
-                const std::variant<float, int, std::string> &value) override {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto &voice : voices) {
-      voice->set_parameter(name, value);
+// Render the audio tap of one JackClient: the mix of its instances' first
+// outputs as a scope with peak and RMS levels
+void render_tap_gui(JackClient *client) {
+  const std::string window_name = std::string("Scope: ") + client->get_name();
+  ImGui::Begin(window_name.c_str());
+  bool enabled = client->is_tap_enabled();
+  if (ImGui::Checkbox("Tap outputs", &enabled)) {
+    client->set_tap_enabled(enabled);
+  }
+  if (AudioTap *tap = client->get_tap()) {
+    int decimation = static_cast<int>(tap->get_decimation());
+    if (ImGui::SliderInt("Decimation", &decimation, 1, 64)) {
+      tap->set_decimation(static_cast<unsigned>(decimation));
     }
+    const TapMeter &meter = client->get_tap_meter();
+    const auto to_db = [](float level) {
+      return 20.0f * std::log10(std::max(level, 1e-6f));
+    };
+    ImGui::Text("Peak %.1f dBFS  RMS %.1f dBFS  dropped %llu",
+                to_db(meter.get_peak()), to_db(meter.get_rms()),
+                static_cast<unsigned long long>(tap->get_dropped()));
+    const auto &scope = meter.get_scope();
+    ImGui::PlotLines("##scope", scope.data(), static_cast<int>(scope.size()),
+                     0, nullptr, -1.0f, 1.0f, ImVec2(0, 80));
   }
+  ImGui::End();
+}
 
-  std::variant<float, int, std::string>
-  get_parameter(const std::string &name) const override {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return voices[0]->get_parameter(name);
-  }
-
-  std::vector<std::string> get_parameter_names() const override {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return voices[0]->get_parameter_names();
-  }
-
-  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
-                     double sample_rate) override {
-    std::vector<float> mixed_output(nframes, 0.0f);
+// One row of timing statistics, with the worst case as a share of the period
+void render_profiler_row(const char *label, const BlockProfiler &profiler,
+                         double period_us) {
+  const BlockProfiler::Stats &stats = profiler.get_stats();
+  ImGui::Text("%s: min %.1f  avg %.1f  p99 %.1f  max %.1f us (%.0f%% of "
+              "period)",
+              label, stats.min_us, stats.avg_us, stats.p99_us, stats.max_us,
+              period_us > 0.0 ? 100.0 * stats.max_us / period_us : 0.0);
+  const auto &histogram = profiler.get_histogram();
+  ImGui::PushID(label);
+  ImGui::PlotHistogram("log2 ns", histogram.data(),
+                       static_cast<int>(histogram.size()), 0, nullptr, 0.0f,
+                       FLT_MAX, ImVec2(0, 40));
+  ImGui::PopID();
+}
 
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto &voice : voices) {
-      std::vector<float *> voice_outputs(1, mixed_output.data());
-      voice->process_audio(nframes, inputs, voice_outputs.data(), sample_rate);
-    }
+// Render GUI for the timing of one JackClient and its instances
+void render_profiler_gui(JackClient *client) {
+  const std::string window_name =
+      std::string("Profiler: ") + client->get_name();
+  ImGui::Begin(window_name.c_str());
+  const double period_us = client->get_period_us();
+  ImGui::Text("JACK DSP load %.1f%%, period %.0f us", client->get_cpu_load(),
+              period_us);
 
-    for (jack_nframes_t i = 0; i < nframes; ++i) {
-      outputs[0][i] = mixed_output[i];
-    }
+  ImGui::Text("Xruns: %llu",
+              static_cast<unsigned long long>(client->get_xrun_count()));
+  const jack_time_t now = jack_get_time();
+  for (jack_time_t time : client->get_recent_xruns()) {
+    ImGui::Text("  %.1f s ago", (now - time) * 1e-6);
   }
 
-  int get_num_inputs() const override {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return voices[0]->get_num_inputs();
+  const auto &callback_stats = client->get_callback_profiler().get_stats();
+  if (callback_stats.dropped > 0) {
+    ImGui::Text("Dropped samples: %llu",
+                static_cast<unsigned long long>(callback_stats.dropped));
   }
-
-  int get_num_outputs() const override {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return voices[0]->get_num_outputs();
-  }
-
-private:
-  std::function<std::unique_ptr<DSP>()> create_dsp;
-  std::vector<std::unique_ptr<DSP>> voices;
-  mutable std::mutex mutex_;
-};
-
-// Thread Manager class
-class ThreadManager {
-public:
-  static void init(unsigned num_threads);
-  static void shutdown();
-  static void run_task(const std::function<void()> &task);
-
-private:
-  static void worker_thread();
-  static bool initialize_thread(unsigned index);
-
-  inline static std::vector<std::thread> threads;
-  inline static std::queue<std::function<void()>> tasks;
-  inline static std::mutex tasks_mutex;
-  inline static std::condition_variable tasks_available;
-  inline static bool quit_flag = false;
-};
-
-void ThreadManager::init(unsigned num_threads) {
-  unsigned thread_count =
-      num_threads == 0 ? std::max(1u, std::thread::hardware_concurrency())
-                       : num_threads;
-
-  threads.clear();
-  threads.reserve(thread_count);
-
-  if (thread_count > 0) {
-    try {
-      for (unsigned i = 0; i < thread_count; ++i) {
-        if (!initialize_thread(i)) {
-          throw std::runtime_error("Failed to initialize worker thread");
-        }
-      }
-    } catch (const std::exception &e) {
-      std::cerr << "Exception caught during thread initialization: " << e.what()
-                << std::endl;
-    }
+  render_profiler_row("callback", client->get_callback_profiler(), period_us);
+  for (const auto &instance : client->get_instances()) {
+    render_profiler_row(instance->name.c_str(), instance->profiler, period_us);
   }
+  ImGui::End();
 }
 
-bool ThreadManager::initialize_thread(unsigned index) {
-  try {
-    threads.emplace_back(worker_thread);
-
-    // Affinitize thread to specific core if required for better performance
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(index % std::thread::hardware_concurrency(), &cpuset);
-    int rc = pthread_setaffinity_np(threads.back().native_handle(),
-                                    sizeof(cpu_set_t), &cpuset);
-    if (rc != 0) {
-      std::cerr << "Error calling pthread_setaffinity_np: " << rc << std::endl;
-    }
-
-    return true;
-  } catch (const std::exception &e) {
-    std::cerr << "Exception in initializing thread: " << e.what() << std::endl;
-    return false;
+// Render per-worker scheduler counters
+void render_thread_pool_gui() {
+  ImGui::Begin("Thread Pool");
+  const auto stats = ThreadManager::worker_stats();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    ImGui::Text("Worker %zu: %llu tasks, %llu steals, %.1f s idle", i,
+                static_cast<unsigned long long>(stats[i].tasks_run),
+                static_cast<unsigned long long>(stats[i].steals),
+                std::chrono::duration<double>(stats[i].idle_time).count());
   }
+  ImGui::End();
 }
 
-void ThreadManager::shutdown() {
-  {
-    std::lock_guard<std::mutex> lock(tasks_mutex);
-    quit_flag = true;
+// Decides when the GUI loop draws a frame.
+//
+// Input is drawn at up to max_fps, plus a few frames after it stops so
+// ImGui can settle hover and release states. Without input, a frame is
+// drawn only when the meters changed, at up to meter_fps. In between, the
+// loop sleeps in glfwWaitEventsTimeout instead of spinning at vsync.
+class FramePacer {
+public:
+  // Frames drawn after the last input or redraw request
+  static constexpr int SETTLE_FRAMES = 3;
+
+  FramePacer(int max_fps, int meter_fps)
+      : max_fps(max_fps), meter_fps(meter_fps) {}
+
+  // Input arrived or something on screen changed outside the meters
+  void request_redraw() { settle_frames = SETTLE_FRAMES; }
+
+  // Seconds the loop may wait for events before it has to look again: until
+  // the next frame when one is pending, otherwise a whole meter interval,
+  // after which the meters are checked again. 0 only while a draw is due.
+  double wait_timeout(double now) const {
+    const double interval =
+        1.0 / std::max(1, settle_frames > 0 ? max_fps : meter_fps);
+    if (settle_frames == 0 && !meters_dirty) {
+      return interval;
+    }
+    return std::max(0.0, last_frame + interval - now);
   }
-  tasks_available.notify_all();
 
-  for (std::thread &t : threads) {
-    if (t.joinable()) {
-      t.join();
+  // Called once per wakeup with whether the meters changed since the last
+  bool should_draw(double now, bool meters_changed) {
+    meters_dirty |= meters_changed;
+    if (settle_frames > 0) {
+      return now >= last_frame + 1.0 / std::max(1, max_fps);
     }
+    return meters_dirty && now >= last_frame + 1.0 / std::max(1, meter_fps);
   }
-  threads.clear();
-}
 
-void ThreadManager::run_task(const std::function<void()> &task) {
-  {
-    std::lock_guard<std::mutex> lock(tasks_mutex);
-    tasks.push(task);
-  }
-  tasks_available.notify_one();
-}
-
-void ThreadManager::worker_thread() {
-  while (true) {
-    std::function<void()> task;
-    {
-      std::unique_lock<std::mutex> lock(tasks_mutex);
-      tasks_available.wait(lock, [] { return !tasks.empty() || quit_flag; });
-
-      if (quit_flag && tasks.empty()) {
-        return;
-      }
-
-      task = std::move(tasks.front());
-      tasks.pop();
+  void frame_drawn(double now) {
+    last_frame = now;
+    meters_dirty = false;
+    if (settle_frames > 0) {
+      --settle_frames;
     }
-
-    // Execute the task
-    task();
   }
-}
 
-// JackClient class to handle generic DSPs
-class JackClient {
-public:
-  JackClient(const char *client_name, std::unique_ptr<DSP> dsp);
-  ~JackClient();
-
-  DSP *get_dsp() { return dsp.get(); }
-  const char *get_name() const { return name.c_str(); }
+  // Frame cap while interacting and meter refresh rate when idle, in Hz
+  int max_fps;
+  int meter_fps;
 
 private:
-  static int process(jack_nframes_t nframes, void *arg);
-  static void jack_shutdown(void *arg);
-
-  void process_audio(jack_nframes_t nframes);
-
-  jack_client_t *client = nullptr;
-  std::vector<jack_port_t *> input_ports;
-  std::vector<jack_port_t *> output_ports;
-  std::unique_ptr<DSP> dsp;
-  std::string name;
+  double last_frame = 0.0;
+  int settle_frames = SETTLE_FRAMES;
+  bool meters_dirty = false;
 };
 
-JackClient::JackClient(const char *client_name, std::unique_ptr<DSP> dsp)
-    : dsp(std::move(dsp)), name(client_name) {
-  client = jack_client_open(name.c_str(), JackNullOption, nullptr);
-  if (!client) {
-    throw std::runtime_error("Failed to open JACK client");
-  }
+// Set by the GLFW input callbacks, picked up by the GUI loop
+bool gui_input_seen = false;
 
-  if (jack_set_process_callback(client, process, this) != 0) {
-    jack_client_close(client);
-    throw std::runtime_error("Failed to set JACK process callback");
-  }
-
-  jack_on_shutdown(client, jack_shutdown, this);
-
-  const int num_inputs = this->dsp->get_num_inputs();
-  const int num_outputs = this->dsp->get_num_outputs();
-
-  input_ports.reserve(num_inputs);   // Reserve memory upfront
-  output_ports.reserve(num_outputs); // Reserve memory upfront
-
-  for (int i = 0; i < num_inputs; ++i) {
-    input_ports.push_back(
-        jack_port_register(client, ("input" + std::to_string(i)).c_str(),
-                           JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0));
-  }
-
-  for (int i = 0; i < num_outputs; ++i) {
-    output_ports.push_back(
-        jack_port_register(client, ("output" + std::to_string(i)).c_str(),
-                           JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0));
-  }
-
-  if (jack_activate(client)) {
-    jack_client_close(client);
-    throw std::runtime_error("Failed to activate JACK client");
-  }
-}
-
-JackClient::~JackClient() {
-  if (client) {
-    jack_client_close(client);
-  }
-}
-
-int JackClient::process(jack_nframes_t nframes, void *arg) {
-  auto *self = static_cast<JackClient *>(arg);
-  self->process_audio(nframes);
-  return 0;
-}
-
-void JackClient::jack_shutdown(void *arg) {
-  auto *self = static_cast<JackClient *>(arg);
-  self->client = nullptr;
-  std::cerr << "JACK client has been shut down" << std::endl;
-}
-
-void JackClient::process_audio(jack_nframes_t nframes) {
-  const double sample_rate = jack_get_sample_rate(client);
-
-  // Local buffers to avoid thread_local issues
-  std::vector<float *> inputs(input_ports.size());
-  std::vector<float *> outputs(output_ports.size());
-
-  for (size_t i = 0; i < input_ports.size(); ++i) {
-    inputs[i] =
-        static_cast<float *>(jack_port_get_buffer(input_ports[i], nframes));
-  }
-
-  for (size_t i = 0; i < output_ports.size(); ++i) {
-    outputs[i] =
-        static_cast<float *>(jack_port_get_buffer(output_ports[i], nframes));
-  }
-
-  dsp->process_audio(nframes, inputs.data(), outputs.data(), sample_rate);
+// Installed before ImGui's GLFW backend, which chains to them
+void install_input_callbacks(GLFWwindow *window) {
+  glfwSetCursorPosCallback(window, [](GLFWwindow *, double, double) {
+    gui_input_seen = true;
+  });
+  glfwSetMouseButtonCallback(window, [](GLFWwindow *, int, int, int) {
+    gui_input_seen = true;
+  });
+  glfwSetScrollCallback(window, [](GLFWwindow *, double, double) {
+    gui_input_seen = true;
+  });
+  glfwSetKeyCallback(window, [](GLFWwindow *, int, int, int, int) {
+    gui_input_seen = true;
+  });
+  glfwSetCharCallback(window, [](GLFWwindow *, unsigned int) {
+    gui_input_seen = true;
+  });
+  glfwSetWindowFocusCallback(window, [](GLFWwindow *, int) {
+    gui_input_seen = true;
+  });
+  glfwSetCursorEnterCallback(window, [](GLFWwindow *, int) {
+    gui_input_seen = true;
+  });
+  glfwSetWindowRefreshCallback(window,
+                               [](GLFWwindow *) { gui_input_seen = true; });
+  glfwSetFramebufferSizeCallback(window, [](GLFWwindow *, int, int) {
+    gui_input_seen = true;
+  });
 }
 
-// Render GUI for a JackClient
-
-
-// Render GUI for a JackClient
-void render_client_gui(JackClient *client) {
-    ImGui::Begin(client->get_name());  
-    ImGui::Text("Simple DSP");
-    DSP *dsp = client->get_dsp();
-  for (const auto &param : dsp->get_parameter_names()) {
-    auto value = dsp->get_parameter(param);
-    if (param == "frequency" && std::holds_alternative<float>(value)) {
-      float fvalue = std::get<float>(value);
-      if (ImGui::SliderFloat(param.c_str(), &fvalue, 20.0f, 20000.0f)) {
-        dsp->set_parameter(param, fvalue);
-      }
-    } else if (param == "amplitude" && std::holds_alternative<float>(value)) {
-      float fvalue = std::get<float>(value);
-      if (ImGui::SliderFloat(param.c_str(), &fvalue, 0.0f, 1.0f)) {
-        dsp->set_parameter(param, fvalue);
-      }
-    } else if (std::holds_alternative<int>(value)) {
-      int ivalue = std::get<int>(value);
-      if (ImGui::SliderInt(param.c_str(), &ivalue, 0, 100)) {
-        dsp->set_parameter(param, ivalue);
-      }
-    } else if (std::holds_alternative<std::string>(value)) {
-      std::string svalue = std::get<std::string>(value);
-      char buffer[128];
-      std::strncpy(buffer, svalue.c_str(), sizeof(buffer));
-      buffer[sizeof(buffer) - 1] = '\0'; // Ensure null termination
-      if (ImGui::InputText(param.c_str(), buffer, sizeof(buffer))) {
-        dsp->set_parameter(param, std::string(buffer));
-      }
-    }
-  }
-  ImGui::End();
+// Integer setting from the environment, or fallback if unset or invalid
+int env_int(const char *name, int fallback) {
+  const char *value = std::getenv(name);
+  const int parsed = value ? std::atoi(value) : 0;
+  return parsed > 0 ? parsed : fallback;
 }
 
-// Main function
-int main(int, char **) {
-  // Register DSP types
-  DSPFactory::instance().register_dsp("SinOsc", []() -> std::unique_ptr<DSP> {
-    return std::make_unique<SinOsc>();
-  });
-
-    DSPFactory::instance().register_dsp(
-      "SquareWave", []() -> std::unique_ptr<DSP> { return
-      std::make_unique<SquareWave>(); });
-  DSPFactory::instance().register_dsp(
-      "SawWave", []() -> std::unique_ptr<DSP> { return
-      std::make_unique<SawWave>(); });
+// Replacement DSP being built on the Reclaimer thread
+struct PendingSwap {
+  JackClient *client;
+  std::string instance_name;
+  DSPSource source;
+  std::future<std::unique_ptr<DSP>> dsp;
+};
 
-  // Initialize threading
-  ThreadManager::init(std::thread::hardware_concurrency());
+// Main function. An optional argument names a session to load at startup.
+int main(int argc, char **argv) {
+  // Register DSP types. DEARJACK_PLUGIN_DIR names the directory plugins
+  // are loaded from, and re-scanned from on request.
+  register_builtin_dsps();
+  const char *plugin_env = std::getenv("DEARJACK_PLUGIN_DIR");
+  PluginLoader plugins(plugin_env ? plugin_env : "plugins");
+  plugins.scan();
+  std::string plugin_status;
+
+  // Initialize threading. DEARJACK_WORKER_CPUS restricts the workers to a
+  // cpulist such as "2-7"; by default they use the process affinity mask.
+  PlacementPolicy placement;
+  if (const char *worker_cpus = std::getenv("DEARJACK_WORKER_CPUS")) {
+    placement.allowed_cpus = ThreadManager::parse_cpu_list(worker_cpus);
+  }
+  ThreadManager::init(std::thread::hardware_concurrency(), placement);
+  Reclaimer::start();
+  int worker_priority = 0;
 
   // Vector for generic JackClients
   std::vector<std::unique_ptr<JackClient>> jack_clients;
+  JackClient *shared_client = nullptr;
+  bool share_client = false;
+  int voices_per_client = 16;
+  // Index into OVERSAMPLING_LABELS; the factor is 1 << index
+  int oversampling_index = 0;
   std::string selected_dsp_type = "SinOsc";
+  std::vector<PendingSwap> pending_swaps;
+
+  // DEARJACK_SESSION names the file the session buttons save to and load
+  // from
+  const char *session_env = std::getenv("DEARJACK_SESSION");
+  const std::string session_path =
+      argc > 1 ? argv[1] : session_env ? session_env : "session.djs";
+  // Replaces every client with the session's. The old ones close on the
+  // Reclaimer thread, since closing a JACK client blocks, and the restore
+  // starts behind them there, once their names are free.
+  std::shared_ptr<SessionRestore> restoring;
+  auto load_clients = [&](const std::string &path) {
+    if (restoring) {
+      return;
+    }
+    try {
+      Session session = load_session(path);
+      pending_swaps.clear();
+      for (auto &client : jack_clients) {
+        Reclaimer::dispose(std::move(client));
+      }
+      jack_clients.clear();
+      shared_client = nullptr;
+      restoring = std::make_shared<SessionRestore>(
+          std::move(session), [] { glfwPostEmptyEvent(); });
+      Reclaimer::post([restore = restoring] { restore->start(); });
+      std::cerr << "Loading session " << path << std::endl;
+    } catch (const std::exception &e) {
+      std::cerr << "Cannot load session: " << e.what() << std::endl;
+    }
+  };
+  size_t restore_steps_seen = 0;
+  auto capture_clients = [&] {
+    std::vector<const JackClient *> clients;
+    for (const auto &client : jack_clients) {
+      clients.push_back(client.get());
+    }
+    return capture_session(clients);
+  };
 
   glfwSetErrorCallback(glfw_error_callback);
   if (!glfwInit()) {
@@ -508,6 +389,12 @@ int main(int, char **) {
 
   glfwMakeContextCurrent(window);
   glfwSwapInterval(1);
+  install_input_callbacks(window);
+
+  // DEARJACK_MAX_FPS caps the frame rate while interacting and
+  // DEARJACK_METER_FPS sets how often changing meters are redrawn when idle
+  FramePacer pacer(env_int("DEARJACK_MAX_FPS", 60),
+                   env_int("DEARJACK_METER_FPS", 15));
 
   IMGUI_CHECKVERSION();
   ImGui::CreateContext();
@@ -516,37 +403,167 @@ int main(int, char **) {
   ImGui_ImplGlfw_InitForOpenGL(window, true);
   ImGui_ImplOpenGL3_Init(glsl_version);
 
+  // Restored in the background while the window is already up
+  if (argc > 1) {
+    load_clients(session_path);
+  }
+
   while (!glfwWindowShouldClose(window)) {
-    glfwPollEvents();
+    const double timeout = pacer.wait_timeout(glfwGetTime());
+    if (timeout > 0.0) {
+      glfwWaitEventsTimeout(timeout);
+    } else {
+      glfwPollEvents();
+    }
+    if (gui_input_seen) {
+      gui_input_seen = false;
+      pacer.request_redraw();
+    }
+
+    // Housekeeping runs on every wakeup, drawn or not
+    const size_t swaps_before = pending_swaps.size();
+    std::erase_if(pending_swaps, [](PendingSwap &swap) {
+      if (swap.dsp.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+        return false;
+      }
+      try {
+        std::unique_ptr<DSP> dsp = swap.dsp.get();
+        if (!swap.client->replace_dsp(swap.instance_name, std::move(dsp),
+                                      swap.source)) {
+          std::cerr << "Instance " << swap.instance_name
+                    << " is gone; swap dropped" << std::endl;
+        }
+      } catch (const std::exception &e) {
+        std::cerr << "DSP swap failed: " << e.what() << std::endl;
+      }
+      return true;
+    });
+    if (pending_swaps.size() != swaps_before) {
+      pacer.request_redraw();
+    }
+    if (restoring) {
+      const size_t steps = restoring->get_completed_steps();
+      if (steps != restore_steps_seen) {
+        restore_steps_seen = steps;
+        pacer.request_redraw();
+      }
+      if (restoring->is_done()) {
+        for (auto &client : restoring->take_clients()) {
+          if (std::strcmp(client->get_name(), "DearJack") == 0) {
+            shared_client = client.get();
+          }
+          jack_clients.push_back(std::move(client));
+        }
+        restoring.reset();
+        restore_steps_seen = 0;
+      }
+    }
+    for (const auto &client : jack_clients) {
+      client->collect_garbage();
+    }
+
+    // Keep workers off the JACK thread's core and at JACK's realtime
+    // priority, so fork/join helpers are not preempted by GUI threads
+    if (!jack_clients.empty()) {
+      ThreadManager::set_avoided_cpu(jack_clients.front()->get_process_cpu());
+      const int priority = jack_clients.front()->get_realtime_priority();
+      if (priority != worker_priority) {
+        worker_priority = priority;
+        ThreadManager::set_realtime_priority(priority);
+      }
+    }
+
+    bool meters_changed = false;
+    for (const auto &client : jack_clients) {
+      meters_changed |= client->update_meters();
+    }
+    const double now = glfwGetTime();
+    if (!pacer.should_draw(now, meters_changed)) {
+      continue;
+    }
+    pacer.frame_drawn(now);
+
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    // Add buttons to add/remove JackClients
+    // Add buttons to add/remove JackClients. With a shared client, new
+    // instances join one JackClient instead of opening their own.
+    ImGui::Checkbox("Share one JACK client", &share_client);
+    ImGui::SliderInt("Voices per client", &voices_per_client, 1, 128);
+    static const char *const OVERSAMPLING_LABELS[] = {"Off", "2x", "4x",
+                                                      "8x"};
+    ImGui::Combo("Oversampling", &oversampling_index, OVERSAMPLING_LABELS,
+                 IM_ARRAYSIZE(OVERSAMPLING_LABELS));
+    const int oversampling = 1 << oversampling_index;
     if (ImGui::Button("Add JackClient")) {
       static int client_count = 1;
       std::string client_name = "DearJack" + std::to_string(client_count++);
-      auto dsp = DSPFactory::instance().create_dsp(selected_dsp_type);
-      // Use PolyphonicDSP to manage multiple voices
-      auto poly_dsp = std::make_unique<PolyphonicDSP>(
-          [dsp_name = selected_dsp_type]() {
-            return DSPFactory::instance().create_dsp(dsp_name);
-          },
-          8);
-      jack_clients.emplace_back(std::make_unique<JackClient>(
-          client_name.c_str(), std::move(poly_dsp)));
+      std::unique_ptr<DSP> poly_dsp = create_instance_dsp(
+          selected_dsp_type, voices_per_client, oversampling);
+      DSPSource source{selected_dsp_type, voices_per_client, oversampling};
+      if (share_client) {
+        if (!shared_client) {
+          jack_clients.emplace_back(std::make_unique<JackClient>("DearJack"));
+          shared_client = jack_clients.back().get();
+        }
+        shared_client->add_instance(client_name, std::move(poly_dsp),
+                                    client_name + "_", std::move(source));
+      } else {
+        jack_clients.emplace_back(std::make_unique<JackClient>(
+            client_name.c_str(), std::move(poly_dsp), std::move(source)));
+      }
     }
     if (ImGui::Button("Remove Last JackClient") && !jack_clients.empty()) {
-      jack_clients.pop_back();
+      JackClient *last = jack_clients.back().get();
+      if (last == shared_client && last->get_instances().size() > 1) {
+        last->remove_instance(last->get_instances().back()->name);
+      } else {
+        if (last == shared_client) {
+          shared_client = nullptr;
+        }
+        std::erase_if(pending_swaps, [last](const PendingSwap &swap) {
+          return swap.client == last;
+        });
+        // Closing a JACK client blocks; keep it off the GUI thread
+        Reclaimer::dispose(std::move(jack_clients.back()));
+        jack_clients.pop_back();
+      }
     }
 
-    // Dropdown to select DSP type
-    const auto &dsp_types = DSPFactory::instance().get_registered_dsps();
-    static int current_dsp_type = 0;
+    // Hot swap: the last instance switches to the selected DSP type once
+    // the replacement has been built, without reconnecting its ports
+    if (ImGui::Button("Swap Last DSP") && !jack_clients.empty() &&
+        !jack_clients.back()->get_instances().empty()) {
+      auto promise = std::make_shared<std::promise<std::unique_ptr<DSP>>>();
+      pending_swaps.push_back({jack_clients.back().get(),
+                               jack_clients.back()->get_instances().back()->name,
+                               {selected_dsp_type, voices_per_client,
+                                oversampling},
+                               promise->get_future()});
+      Reclaimer::post([promise, type = selected_dsp_type,
+                       voices = voices_per_client, oversampling] {
+        try {
+          promise->set_value(create_instance_dsp(type, voices, oversampling));
+        } catch (...) {
+          promise->set_exception(std::current_exception());
+        }
+        // Wake the GUI loop to apply the swap
+        glfwPostEmptyEvent();
+      });
+    }
+
+    // Dropdown to select DSP type. The index is looked up every frame, as
+    // a re-scan can add or remove types.
+    const auto dsp_types = DSPFactory::instance().get_registered_dsps();
+    int current_dsp_type = static_cast<int>(
+        std::find(dsp_types.begin(), dsp_types.end(), selected_dsp_type) -
+        dsp_types.begin());
     if (ImGui::Combo(
             "DSP Type", &current_dsp_type,
             [](void *data, int idx, const char **out_text) {
-              *out_text = static_cast<std::vector<std::string> *>(data)
+              *out_text = static_cast<const std::vector<std::string> *>(data)
                               ->at(idx)
                               .c_str();
               return true;
@@ -554,11 +571,61 @@ int main(int, char **) {
             (void *)&dsp_types, dsp_types.size())) {
       selected_dsp_type = dsp_types[current_dsp_type];
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Rescan Plugins")) {
+      const PluginLoader::ScanResult result = plugins.scan();
+      char status[128];
+      std::snprintf(status, sizeof(status),
+                    "%zu loaded, %zu removed, %zu failed", result.loaded,
+                    result.removed, result.failed);
+      plugin_status = status;
+      if (!DSPFactory::instance().has_dsp(selected_dsp_type)) {
+        selected_dsp_type = "SinOsc";
+      }
+    }
+    if (!plugin_status.empty()) {
+      ImGui::SameLine();
+      ImGui::TextUnformatted(plugin_status.c_str());
+    }
+
+    // Sessions save the rig, parameters and connections to session_path
+    if (ImGui::Button("Save Session")) {
+      try {
+        save_session(capture_clients(), session_path);
+      } catch (const std::exception &e) {
+        std::cerr << "Cannot save session: " << e.what() << std::endl;
+      }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Session")) {
+      load_clients(session_path);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export JSON")) {
+      std::ofstream json(session_path + ".json");
+      json << session_to_json(capture_clients());
+    }
+    if (restoring) {
+      const size_t total = std::max<size_t>(1, restoring->get_total_steps());
+      char overlay[64];
+      std::snprintf(overlay, sizeof(overlay), "Restoring session %zu/%zu",
+                    restoring->get_completed_steps(), total);
+      ImGui::ProgressBar(
+          static_cast<float>(restoring->get_completed_steps()) / total,
+          ImVec2(-1, 0), overlay);
+    }
+
+    ImGui::SliderInt("Frame cap", &pacer.max_fps, 10, 240);
+    ImGui::SliderInt("Meter rate", &pacer.meter_fps, 1, 60);
 
     // Render GUI for each JackClient
     for (const auto &client : jack_clients) {
       render_client_gui(client.get());
+      render_profiler_gui(client.get());
+      render_tap_gui(client.get());
+      client->commit_parameters();
     }
+    render_thread_pool_gui();
 
     ImGui::Render();
     int display_w, display_h;
@@ -571,13 +638,23 @@ int main(int, char **) {
     glfwSwapBuffers(window);
   }
 
+  // DSP builds and a session restore still in flight wake the loop through
+  // GLFW when done
+  Reclaimer::drain();
+  if (restoring) {
+    restoring->wait();
+  }
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
   glfwDestroyWindow(window);
   glfwTerminate();
 
-  // Shutdown threading
+  // Shutdown threading. Clients close before the Reclaimer stops, since
+  // closing them may still queue work.
+  pending_swaps.clear();
+  jack_clients.clear();
+  Reclaimer::shutdown();
   ThreadManager::shutdown();
 
   return 0;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <jack/jack.h>
+
+// Note message from a MIDI input port, timestamped within the block it
+// arrived in
+struct MidiEvent {
+  enum class Type { NoteOn, NoteOff };
+
+  jack_nframes_t offset = 0; // Frames from the start of the block
+  Type type = Type::NoteOn;
+  int note = 0;
+  float velocity = 0.0f; // In [0, 1], 0 for note-off
+};
+
+// Decodes one raw MIDI message on any channel. Returns false for anything
+// but note messages; a note-on with velocity 0 is a note-off, as running
+// status senders use it.
+inline bool decode_midi_message(const uint8_t *data, size_t size,
+                                jack_nframes_t offset, MidiEvent &event) {
+  if (size < 3) {
+    return false;
+  }
+  const uint8_t status = data[0] & 0xF0;
+  if (status != 0x80 && status != 0x90) {
+    return false;
+  }
+  event.offset = offset;
+  event.note = data[1] & 0x7F;
+  const int velocity = data[2] & 0x7F;
+  if (status == 0x90 && velocity > 0) {
+    event.type = MidiEvent::Type::NoteOn;
+    event.velocity = static_cast<float>(velocity) / 127.0f;
+  } else {
+    event.type = MidiEvent::Type::NoteOff;
+    event.velocity = 0.0f;
+  }
+  return true;
+}
@@ -0,0 +1,278 @@
+#include "osc.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Largest UDP payload over IPv4
+constexpr size_t MAX_PACKET_SIZE = 65507;
+// Packets decoded per poll(), so a flood cannot starve the caller's loop
+constexpr size_t MAX_PACKETS_PER_POLL = 1024;
+// Bundles nested deeper than this are treated as malformed
+constexpr int MAX_BUNDLE_DEPTH = 8;
+
+// Big-endian reader over one packet; every field is 4-byte aligned
+class OscReader {
+public:
+  OscReader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+  bool at_end() const { return position == size; }
+
+  bool read_u32(uint32_t &value) {
+    if (size - position < 4) {
+      return false;
+    }
+    value = (uint32_t{data[position]} << 24) |
+            (uint32_t{data[position + 1]} << 16) |
+            (uint32_t{data[position + 2]} << 8) | data[position + 3];
+    position += 4;
+    return true;
+  }
+
+  bool read_u64(uint64_t &value) {
+    uint32_t high, low;
+    if (!read_u32(high) || !read_u32(low)) {
+      return false;
+    }
+    value = (uint64_t{high} << 32) | low;
+    return true;
+  }
+
+  // Null-terminated, padded with nulls to a multiple of 4 bytes
+  bool read_string(std::string &value) {
+    const void *end = std::memchr(data + position, '\0', size - position);
+    if (!end) {
+      return false;
+    }
+    const size_t length = static_cast<const uint8_t *>(end) - data - position;
+    const size_t padded = (length + 4) & ~size_t{3};
+    if (padded > size - position) {
+      return false;
+    }
+    value.assign(reinterpret_cast<const char *>(data + position), length);
+    position += padded;
+    return true;
+  }
+
+  // Sub-reader over the next size bytes
+  bool read_block(size_t block_size, OscReader &block) {
+    if (block_size % 4 != 0 || block_size > size - position) {
+      return false;
+    }
+    block = OscReader(data + position, block_size);
+    position += block_size;
+    return true;
+  }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t position = 0;
+};
+
+bool parse_message(OscReader &reader, const OscHandler &handle) {
+  OscMessage message;
+  std::string tags;
+  if (!reader.read_string(message.address) || message.address.empty() ||
+      message.address[0] != '/') {
+    return false;
+  }
+  // A message without a type tag string has no arguments
+  if (!reader.at_end() && (!reader.read_string(tags) || tags.empty() ||
+                           tags[0] != ',')) {
+    return false;
+  }
+  for (size_t t = 1; t < tags.size(); ++t) {
+    uint32_t bits;
+    switch (tags[t]) {
+    case 'i':
+      if (!reader.read_u32(bits)) {
+        return false;
+      }
+      message.arguments.emplace_back(static_cast<int32_t>(bits));
+      break;
+    case 'f': {
+      if (!reader.read_u32(bits)) {
+        return false;
+      }
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+      message.arguments.emplace_back(value);
+      break;
+    }
+    case 'd': {
+      uint64_t wide;
+      if (!reader.read_u64(wide)) {
+        return false;
+      }
+      double value;
+      std::memcpy(&value, &wide, sizeof(value));
+      message.arguments.emplace_back(static_cast<float>(value));
+      break;
+    }
+    case 's': {
+      std::string value;
+      if (!reader.read_string(value)) {
+        return false;
+      }
+      message.arguments.emplace_back(std::move(value));
+      break;
+    }
+    case 'T':
+      message.arguments.emplace_back(int32_t{1});
+      break;
+    case 'F':
+      message.arguments.emplace_back(int32_t{0});
+      break;
+    default:
+      return false;
+    }
+  }
+  handle(message);
+  return true;
+}
+
+bool parse_element(OscReader &reader, const OscHandler &handle, int depth) {
+  // Peek at the address to tell bundles from messages
+  OscReader peek = reader;
+  std::string head;
+  if (!peek.read_string(head)) {
+    return false;
+  }
+  if (head != "#bundle") {
+    return parse_message(reader, handle);
+  }
+  if (depth >= MAX_BUNDLE_DEPTH) {
+    return false;
+  }
+
+  uint64_t time_tag;
+  reader = peek;
+  if (!reader.read_u64(time_tag)) {
+    return false;
+  }
+  bool ok = true;
+  while (!reader.at_end()) {
+    uint32_t element_size;
+    OscReader element(nullptr, 0);
+    if (!reader.read_u32(element_size) ||
+        !reader.read_block(element_size, element)) {
+      return false;
+    }
+    ok &= parse_element(element, handle, depth + 1);
+  }
+  return ok;
+}
+
+void write_u32(uint32_t value, std::vector<uint8_t> &out) {
+  out.push_back(static_cast<uint8_t>(value >> 24));
+  out.push_back(static_cast<uint8_t>(value >> 16));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+void write_string(const std::string &value, std::vector<uint8_t> &out) {
+  out.insert(out.end(), value.begin(), value.end());
+  out.resize(out.size() + 4 - value.size() % 4, 0);
+}
+
+} // namespace
+
+bool parse_osc_packet(const uint8_t *data, size_t size,
+                      const OscHandler &handle) {
+  if (size == 0 || size % 4 != 0) {
+    return false;
+  }
+  OscReader reader(data, size);
+  return parse_element(reader, handle, 0);
+}
+
+void encode_osc_message(const OscMessage &message, std::vector<uint8_t> &out) {
+  std::string tags = ",";
+  for (const OscArgument &argument : message.arguments) {
+    tags += std::holds_alternative<int32_t>(argument) ? 'i'
+            : std::holds_alternative<float>(argument) ? 'f'
+                                                      : 's';
+  }
+  write_string(message.address, out);
+  write_string(tags, out);
+  for (const OscArgument &argument : message.arguments) {
+    if (const int32_t *i = std::get_if<int32_t>(&argument)) {
+      write_u32(static_cast<uint32_t>(*i), out);
+    } else if (const float *f = std::get_if<float>(&argument)) {
+      uint32_t bits;
+      std::memcpy(&bits, f, sizeof(bits));
+      write_u32(bits, out);
+    } else {
+      write_string(std::get<std::string>(argument), out);
+    }
+  }
+}
+
+OscServer::OscServer(uint16_t requested_port, const std::string &bind_address)
+    : buffer(MAX_PACKET_SIZE) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  if (::inet_pton(AF_INET, bind_address.c_str(), &address.sin_addr) != 1) {
+    throw std::runtime_error("Invalid OSC bind address: " + bind_address);
+  }
+  address.sin_port = htons(requested_port);
+  fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Failed to create OSC socket: ") +
+                             std::strerror(errno));
+  }
+  if (::bind(fd, reinterpret_cast<const sockaddr *>(&address),
+             sizeof(address)) != 0) {
+    const int error = errno;
+    ::close(fd);
+    throw std::runtime_error("Failed to bind OSC port " + bind_address +
+                             ":" + std::to_string(requested_port) + ": " +
+                             std::strerror(error));
+  }
+  socklen_t length = sizeof(address);
+  ::getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length);
+  port = ntohs(address.sin_port);
+}
+
+OscServer::~OscServer() { ::close(fd); }
+
+size_t OscServer::poll(int timeout_ms, const OscHandler &handle) {
+  pollfd descriptor{fd, POLLIN, 0};
+  if (::poll(&descriptor, 1, timeout_ms) <= 0) {
+    return 0; // Timeout, or interrupted by a signal
+  }
+  size_t packets = 0;
+  while (packets < MAX_PACKETS_PER_POLL) {
+    socklen_t sender_length = sizeof(sender);
+    const ssize_t received =
+        ::recvfrom(fd, buffer.data(), buffer.size(), 0,
+                   reinterpret_cast<sockaddr *>(&sender), &sender_length);
+    if (received < 0) {
+      // EAGAIN once the socket is drained
+      break;
+    }
+    ++packets;
+    if (!parse_osc_packet(buffer.data(), static_cast<size_t>(received),
+                          handle)) {
+      std::fprintf(stderr, "Malformed OSC packet (%zd bytes)\n", received);
+    }
+  }
+  return packets;
+}
+
+void OscServer::reply(const OscMessage &message) {
+  reply_buffer.clear();
+  encode_osc_message(message, reply_buffer);
+  // Best effort, like the rest of UDP: a full send buffer drops the reply
+  ::sendto(fd, reply_buffer.data(), reply_buffer.size(), MSG_DONTWAIT,
+           reinterpret_cast<const sockaddr *>(&sender), sizeof(sender));
+}
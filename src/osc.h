@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <netinet/in.h>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Minimal Open Sound Control 1.0 receiver over UDP, for driving the engine
+// from a remote control host.
+//
+// Messages carry int32 ('i'), float32 ('f') and string ('s') arguments;
+// doubles ('d') arrive as floats and the booleans 'T' and 'F' as 1 and 0.
+// Bundles may nest and are delivered message by message in order. Time
+// tags are ignored: everything is applied as soon as it is received.
+using OscArgument = std::variant<int32_t, float, std::string>;
+
+struct OscMessage {
+  std::string address;
+  std::vector<OscArgument> arguments;
+};
+
+using OscHandler = std::function<void(const OscMessage &)>;
+
+// Decodes one packet, a message or a bundle, calling handle for each
+// message in it. Malformed elements are skipped; returns false if there
+// were any.
+bool parse_osc_packet(const uint8_t *data, size_t size,
+                      const OscHandler &handle);
+
+// Appends message to out as one packet, with int32, float32 and string
+// arguments
+void encode_osc_message(const OscMessage &message, std::vector<uint8_t> &out);
+
+// Non-blocking UDP socket receiving OSC packets
+class OscServer {
+public:
+  // Binds the IPv4 address bind_address on port, or an ephemeral port for
+  // 0. Only local processes can reach the default loopback address; pass
+  // "0.0.0.0" for every interface. Throws std::runtime_error if the address
+  // is invalid or the socket cannot be bound.
+  explicit OscServer(uint16_t port,
+                     const std::string &bind_address = "127.0.0.1");
+  ~OscServer();
+
+  OscServer(const OscServer &) = delete;
+  OscServer &operator=(const OscServer &) = delete;
+
+  // Waits up to timeout_ms for a packet, then decodes the packets already
+  // queued on the socket, so a burst of updates is handled as one batch.
+  // Returns the number of packets received.
+  size_t poll(int timeout_ms, const OscHandler &handle);
+
+  // Sends message back to where the packet being handled came from. Only
+  // valid inside poll()'s handler.
+  void reply(const OscMessage &message);
+
+  uint16_t get_port() const { return port; }
+
+private:
+  int fd = -1;
+  uint16_t port = 0;
+  std::vector<uint8_t> buffer; // One datagram
+  sockaddr_in sender{};        // Of the packet in buffer
+  std::vector<uint8_t> reply_buffer;
+};
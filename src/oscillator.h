@@ -0,0 +1,229 @@
+#pragma once
+
+#include "dsp.h"
+#include "phase_accumulator.h"
+#include "simd.h"
+#include "smoothed_parameter.h"
+#include "wavetable.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <utility>
+
+// Oscillator base: owns the frequency/amplitude parameters and leaves the
+// phase and the rendering of a block to BasicOscillator. Both parameters are
+// smoothed, so automation sweeps per sample at any buffer size.
+class Oscillator : public DSP {
+public:
+  static constexpr ParameterId FREQUENCY = 0;
+  static constexpr ParameterId AMPLITUDE = 1;
+
+  Oscillator()
+      : frequency(DEFAULT_FREQUENCY), amplitude(DEFAULT_AMPLITUDE),
+        frequency_smoother(descriptor_table()[FREQUENCY]),
+        amplitude_smoother(descriptor_table()[AMPLITUDE]) {}
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return descriptor_table();
+  }
+
+  void set_parameter(ParameterId id, const ParameterValue &value) override {
+    switch (id) {
+    case FREQUENCY:
+      frequency.store(parameter_as_float(value));
+      break;
+    case AMPLITUDE:
+      amplitude.store(parameter_as_float(value));
+      break;
+    }
+  }
+
+  ParameterValue get_parameter(ParameterId id) const override {
+    switch (id) {
+    case FREQUENCY:
+      return frequency.load();
+    case AMPLITUDE:
+      return amplitude.load();
+    }
+    throw std::runtime_error("Unknown parameter id: " + std::to_string(id));
+  }
+
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double sample_rate) override {
+    const ParameterRamp hz =
+        frequency_smoother.next_block(frequency.load(), nframes, sample_rate);
+    const ParameterRamp amp =
+        amplitude_smoother.next_block(amplitude.load(), nframes, sample_rate);
+    // Once per block, so worked out in double for the fixed-point phase
+    render_block(outputs[0], nframes, hz.start / sample_rate,
+                 hz.step / sample_rate, amp);
+  }
+
+  void reset_smoothing() override {
+    frequency_smoother.reset();
+    amplitude_smoother.reset();
+  }
+
+  int get_num_inputs() const override { return 0; }
+  int get_num_outputs() const override { return 1; }
+
+protected:
+  // Renders one block of the waveform scaled by amp and advances the
+  // phase. Increments are in cycles; the increment at sample i is
+  // phase_increment + i * increment_step. Called once per block.
+  virtual void render_block(float *out, jack_nframes_t nframes,
+                            double phase_increment, double increment_step,
+                            ParameterRamp amp) = 0;
+
+private:
+  static const std::vector<ParameterDescriptor> &descriptor_table() {
+    static const std::vector<ParameterDescriptor> descriptors = {
+        {FREQUENCY, "frequency", ParameterType::Float, 20.0f, 20000.0f,
+         DEFAULT_FREQUENCY, Smoothing::Exponential, DEFAULT_SMOOTHING_TIME},
+        {AMPLITUDE, "amplitude", ParameterType::Float, 0.0f, 1.0f,
+         DEFAULT_AMPLITUDE, Smoothing::Linear, DEFAULT_SMOOTHING_TIME},
+    };
+    return descriptors;
+  }
+
+  std::atomic<float> frequency;
+  std::atomic<float> amplitude;
+  // Audio thread only
+  SmoothedParameter frequency_smoother;
+  SmoothedParameter amplitude_smoother;
+};
+
+// Waveform functors evaluate one cycle-normalized phase per lane. The call
+// operator is a template over simd::vfloat and float so BasicOscillator can
+// inline it into both the vector loop and the scalar tail.
+struct SineWaveform {
+  template <typename V> V operator()(V phase) const {
+    return simd::sin_cycles(phase);
+  }
+};
+
+struct SquareWaveform {
+  template <typename V> V operator()(V phase) const {
+    return simd::square_cycles(phase);
+  }
+};
+
+struct SawWaveform {
+  template <typename V> V operator()(V phase) const {
+    return simd::saw_cycles(phase);
+  }
+};
+
+// Band-limited waveform read from a shared mip-mapped table set. The table
+// level is picked once per block from the largest phase increment in it.
+class WavetableWaveform {
+public:
+  explicit WavetableWaveform(std::shared_ptr<const WavetableSet> tables)
+      : tables(std::move(tables)) {}
+
+  // Waveform bound to the table level for one block
+  struct Block {
+    const float *table;
+
+    template <typename V> V operator()(V phase) const {
+      return WavetableSet::lookup(table, phase);
+    }
+  };
+
+  Block for_block(double phase_increment) const {
+    return Block{tables->table_for(phase_increment)};
+  }
+
+private:
+  std::shared_ptr<const WavetableSet> tables;
+};
+
+struct BandLimitedSquareWaveform : WavetableWaveform {
+  BandLimitedSquareWaveform() : WavetableWaveform(WavetableSet::square()) {}
+};
+
+struct BandLimitedSawWaveform : WavetableWaveform {
+  BandLimitedSawWaveform() : WavetableWaveform(WavetableSet::saw()) {}
+};
+
+// Waveforms may provide for_block(phase_increment) to precompute per-block
+// state; stateless ones are used as-is
+template <typename Waveform>
+decltype(auto) waveform_for_block(const Waveform &waveform,
+                                  double phase_increment) {
+  if constexpr (requires { waveform.for_block(phase_increment); }) {
+    return waveform.for_block(phase_increment);
+  } else {
+    return (waveform);
+  }
+}
+
+// Oscillator core specialized at compile time on its waveform and phase
+// accumulator (see phase_accumulator.h), so the sample loop contains no
+// indirect calls and runs on full-width float vectors. New waveforms only
+// need a functor and a DSPFactory registration.
+template <typename Waveform, typename Phase = FixedPointPhase>
+class BasicOscillator : public Oscillator {
+public:
+  BasicOscillator() = default;
+  explicit BasicOscillator(Waveform waveform) : waveform(std::move(waveform)) {}
+
+  // Audio thread, or any thread while not processing; for checks
+  double get_phase() const { return phase.get_cycles(); }
+
+protected:
+  void render_block(float *out, jack_nframes_t nframes, double phase_increment,
+                    double increment_step, ParameterRamp amp) override {
+    using simd::vfloat;
+    using Increment = typename Phase::Increment;
+    constexpr jack_nframes_t width = vfloat::width;
+    const double last_increment =
+        phase_increment + increment_step * (nframes > 0 ? nframes - 1 : 0);
+    const auto &wave = waveform_for_block(
+        waveform, std::max(phase_increment, last_increment));
+    // Lane k of a vector is k samples in: its phase is ahead by k increments
+    // plus k * (k - 1) / 2 increment steps
+    const vfloat lanes = vfloat::ramp();
+    const vfloat lane_steps = lanes * (lanes - vfloat(1.0f)) * vfloat(0.5f);
+    const vfloat amp_step(amp.step);
+    Increment increment = Phase::to_increment(phase_increment);
+    const Increment step = Phase::to_increment(increment_step);
+    const vfloat lane_step(Phase::to_cycles(step));
+    const Increment vector_step = step * Increment(width);
+    const Increment vector_ramp = step * Increment(width * (width - 1) / 2);
+
+    jack_nframes_t i = 0;
+    for (; i + width <= nframes; i += width) {
+      const vfloat lane_phases = simd::mul_add(
+          lane_steps, lane_step,
+          simd::mul_add(lanes, vfloat(Phase::to_cycles(increment)),
+                        vfloat(phase.get())));
+      const vfloat lane_amps =
+          simd::mul_add(vfloat(static_cast<float>(i)) + lanes, amp_step,
+                        vfloat(amp.start));
+      (wave(lane_phases) * lane_amps).store(out + i);
+      phase.advance(increment * Increment(width) + vector_ramp);
+      increment += vector_step;
+    }
+    for (; i < nframes; ++i) {
+      out[i] = amp.at(i) * wave(phase.get());
+      phase.advance(increment);
+      increment += step;
+    }
+  }
+
+private:
+  Waveform waveform;
+  Phase phase; // Audio thread
+};
+
+using SinOsc = BasicOscillator<SineWaveform>;
+using SquareWave = BasicOscillator<SquareWaveform>;
+using SawWave = BasicOscillator<SawWaveform>;
+using BandLimitedSquareWave = BasicOscillator<BandLimitedSquareWaveform>;
+using BandLimitedSawWave = BasicOscillator<BandLimitedSawWaveform>;
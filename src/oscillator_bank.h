@@ -0,0 +1,262 @@
+#pragma once
+
+#include "dsp.h"
+#include "simd.h"
+#include "smoothed_parameter.h"
+#include "spsc_queue.h"
+#include "voice_allocator.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Polyphonic oscillator with its voices in structure-of-arrays form.
+//
+// Phase, frequency and fade level of every voice live in contiguous,
+// cache-aligned arrays, and each SIMD lane renders one voice: a group of
+// vfloat::width voices advances together sample by sample. Lane sums are
+// accumulated per sample and reduced once at the end of the block, so the
+// cost per voice is a handful of vector operations per sample with no
+// virtual calls. Groups without a sounding voice are skipped.
+//
+// Waveforms are the naive per-sample functors; band-limited tables need a
+// table per voice and are left to PolyphonicDSP. Storage is sized for
+// MAX_VOICES, and only the first num_voices are allocated to notes.
+template <typename Waveform> class OscillatorBank : public DSP {
+public:
+  static constexpr size_t MAX_VOICES = 128;
+  static constexpr ParameterId AMPLITUDE = 0;
+
+  using StealPolicy = VoiceAllocator::StealPolicy;
+
+  // Throws std::invalid_argument unless 1 <= num_voices <= MAX_VOICES
+  explicit OscillatorBank(int num_voices = MAX_VOICES)
+      : num_voices(checked_voice_count(num_voices)),
+        allocator(this->num_voices),
+        amplitude_smoother(descriptor_table()[AMPLITUDE]) {}
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return descriptor_table();
+  }
+
+  void set_parameter(ParameterId id, const ParameterValue &value) override {
+    if (id == AMPLITUDE) {
+      amplitude.store(parameter_as_float(value));
+    }
+  }
+
+  ParameterValue get_parameter(ParameterId id) const override {
+    if (id == AMPLITUDE) {
+      return amplitude.load();
+    }
+    throw std::runtime_error("Unknown parameter id: " + std::to_string(id));
+  }
+
+  void note_on(int note, float velocity) override {
+    note_events.try_push(NoteEvent{note, std::clamp(velocity, 0.0f, 1.0f)});
+  }
+
+  void note_off(int note) override {
+    note_events.try_push(NoteEvent{note, 0.0f});
+  }
+
+  bool receives_midi() const override { return true; }
+  void handle_event(const MidiEvent &event) override {
+    if (event.type == MidiEvent::Type::NoteOn) {
+      start_note(event.note, event.velocity);
+    } else {
+      release_note(event.note);
+    }
+  }
+
+  void set_steal_policy(StealPolicy policy) {
+    steal_policy.store(policy, std::memory_order_relaxed);
+  }
+
+  VoiceUsage get_voice_usage() const override {
+    return {active_voices, static_cast<uint32_t>(num_voices)};
+  }
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override {
+    max_block = max_frames;
+    envelope_step = static_cast<float>(1.0 / (FADE_SECONDS * sample_rate));
+    inverse_sample_rate = static_cast<float>(1.0 / sample_rate);
+    lane_sums.assign(static_cast<size_t>(max_frames) * width, 0.0f);
+  }
+
+  void process_audio(jack_nframes_t nframes, float **, float **outputs,
+                     double sample_rate) override {
+    note_events.consume_all([this](const NoteEvent &event) {
+      if (event.velocity > 0.0f) {
+        start_note(event.note, event.velocity);
+      } else {
+        release_note(event.note);
+      }
+    });
+
+    const ParameterRamp amp =
+        amplitude_smoother.next_block(amplitude.load(), nframes, sample_rate);
+    for (jack_nframes_t offset = 0; offset < nframes; offset += max_block) {
+      const jack_nframes_t frames = std::min(max_block, nframes - offset);
+      render(outputs[0] + offset, frames, {amp.at(offset), amp.step});
+    }
+    if (max_block == 0) {
+      std::fill_n(outputs[0], nframes, 0.0f);
+    }
+  }
+
+  void reset_smoothing() override { amplitude_smoother.reset(); }
+
+  int get_num_inputs() const override { return 0; }
+  int get_num_outputs() const override { return 1; }
+
+private:
+  using vfloat = simd::vfloat;
+  static constexpr size_t width = vfloat::width;
+  static_assert(MAX_VOICES % width == 0);
+  // Attack and release time of the per-voice fade, as in PolyphonicDSP
+  static constexpr double FADE_SECONDS = 0.005;
+  // Samples between phase wraps; keeps phases small enough for float
+  static constexpr jack_nframes_t PHASE_CHUNK = 16;
+
+  struct NoteEvent {
+    int note = 0;
+    float velocity = 0.0f; // 0 for note-off
+  };
+
+  static size_t checked_voice_count(int num_voices) {
+    if (num_voices < 1 || static_cast<size_t>(num_voices) > MAX_VOICES) {
+      throw std::invalid_argument("An oscillator bank has 1 to " +
+                                  std::to_string(MAX_VOICES) + " voices");
+    }
+    return static_cast<size_t>(num_voices);
+  }
+
+  static const std::vector<ParameterDescriptor> &descriptor_table() {
+    static const std::vector<ParameterDescriptor> descriptors = {
+        {AMPLITUDE, "amplitude", ParameterType::Float, 0.0f, 1.0f,
+         DEFAULT_AMPLITUDE, Smoothing::Linear, DEFAULT_SMOOTHING_TIME},
+    };
+    return descriptors;
+  }
+
+  // Audio thread
+  void start_note(int note, float velocity) {
+    const unsigned v =
+        allocator.allocate(note, steal_policy.load(std::memory_order_relaxed));
+    frequency[v] = note_to_frequency(note);
+    target[v] = velocity;
+  }
+
+  void release_note(int note) {
+    allocator.release(note, [this](unsigned v) { target[v] = 0.0f; });
+  }
+
+  void render(float *out, jack_nframes_t frames, ParameterRamp amp) {
+    std::fill_n(lane_sums.begin(), static_cast<size_t>(frames) * width, 0.0f);
+    active_voices = 0;
+    // Lanes past num_voices in the last group stay silent
+    for (size_t group = 0; group < num_voices; group += width) {
+      const size_t group_end = std::min(group + width, num_voices);
+      bool sounding = false;
+      bool fading = false;
+      for (size_t v = group; v < group_end; ++v) {
+        sounding |= !allocator.is_idle(static_cast<unsigned>(v));
+        fading |= gain[v] != target[v];
+      }
+      if (!sounding) {
+        continue;
+      }
+      // Held voices skip the fade arithmetic
+      if (fading) {
+        render_group<true>(group, frames);
+      } else {
+        render_group<false>(group, frames);
+      }
+
+      for (size_t v = group; v < group_end; ++v) {
+        active_voices += !allocator.is_idle(static_cast<unsigned>(v));
+        allocator[v].level = gain[v];
+        if (allocator[v].stage == VoiceAllocator::Stage::Releasing &&
+            gain[v] == 0.0f) {
+          allocator.finish(static_cast<unsigned>(v));
+        }
+      }
+    }
+
+    for (jack_nframes_t i = 0; i < frames; ++i) {
+      const float *sum = lane_sums.data() + i * width;
+      float total = 0.0f;
+      for (size_t lane = 0; lane < width; ++lane) {
+        total += sum[lane];
+      }
+      out[i] = amp.at(i) * total;
+    }
+  }
+
+  // Adds one group of voices into the lane sums
+  template <bool Fading>
+  void render_group(size_t group, jack_nframes_t frames) {
+    const Waveform wave{};
+    const vfloat step(envelope_step);
+    const vfloat negative_step = vfloat(0.0f) - step;
+    vfloat lane_phase = vfloat::load(phase.data() + group);
+    const vfloat increment =
+        vfloat::load(frequency.data() + group) * vfloat(inverse_sample_rate);
+    vfloat lane_gain = vfloat::load(gain.data() + group);
+    const vfloat lane_target = vfloat::load(target.data() + group);
+
+    // Phases within a chunk are computed from the chunk's start rather than
+    // accumulated, so consecutive samples do not wait on each other
+    jack_nframes_t i = 0;
+    while (i < frames) {
+      const jack_nframes_t chunk_end = std::min(frames, i + PHASE_CHUNK);
+      vfloat offset(0.0f);
+      for (; i < chunk_end; ++i) {
+        if constexpr (Fading) {
+          vfloat delta = lane_target - lane_gain;
+          delta = simd::select(delta > step, step, delta);
+          delta = simd::select(delta < negative_step, negative_step, delta);
+          lane_gain = lane_gain + delta;
+        }
+        float *sum = lane_sums.data() + i * width;
+        const vfloat sample_phase = simd::mul_add(offset, increment, lane_phase);
+        simd::mul_add(wave(sample_phase), lane_gain, vfloat::load(sum))
+            .store(sum);
+        offset = offset + vfloat(1.0f);
+      }
+      lane_phase = simd::mul_add(offset, increment, lane_phase);
+      lane_phase = lane_phase - simd::floor(lane_phase);
+    }
+    lane_phase.store(phase.data() + group);
+    lane_gain.store(gain.data() + group);
+  }
+
+  size_t num_voices;
+  // Voice state, one element per voice
+  alignas(64) std::array<float, MAX_VOICES> phase{};
+  alignas(64) std::array<float, MAX_VOICES> frequency{};
+  alignas(64) std::array<float, MAX_VOICES> gain{};
+  alignas(64) std::array<float, MAX_VOICES> target{};
+  VoiceAllocator allocator;
+
+  std::atomic<float> amplitude{DEFAULT_AMPLITUDE};
+  SmoothedParameter amplitude_smoother; // Audio thread only
+  std::atomic<StealPolicy> steal_policy{StealPolicy::Oldest};
+  SPSCQueue<NoteEvent, 256> note_events;
+  uint32_t active_voices = 0; // Audio thread, as of the last render
+
+  // Set by prepare
+  float envelope_step = 0.0f;
+  float inverse_sample_rate = 0.0f;
+  jack_nframes_t max_block = 0;
+  // Per-sample lane sums, vfloat::width floats per frame
+  std::vector<float> lane_sums;
+};
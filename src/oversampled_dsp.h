@@ -0,0 +1,172 @@
+#pragma once
+
+#include "dsp.h"
+#include "half_band.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Oversampled DSP Class
+//
+// Runs a DSP at 2, 4 or 8 times the host rate, for nonlinear or
+// high-frequency processing that would otherwise alias. Every input goes up
+// through a cascade of 2x half-band stages, the DSP renders at the higher
+// rate, and every output comes back down the same way. Only instances
+// created with an oversampling factor pay for it; everything but the audio
+// is forwarded to the wrapped DSP unchanged.
+//
+// All stage buffers are sized in prepare, so process_audio never allocates.
+// The filters delay the signal by a few dozen frames, which get_latency
+// reports so JACK can compensate.
+class OversampledDSP : public DSP {
+public:
+  // Throws std::invalid_argument unless factor is 2, 4 or 8
+  OversampledDSP(std::unique_ptr<DSP> dsp, int factor)
+      : dsp(std::move(dsp)), factor(factor),
+        num_stages(factor == 2 ? 1 : factor == 4 ? 2 : factor == 8 ? 3 : 0),
+        inputs_up(this->dsp->get_num_inputs()),
+        outputs_down(this->dsp->get_num_outputs()),
+        stage_inputs(inputs_up.size()), stage_outputs(outputs_down.size()) {
+    if (num_stages == 0) {
+      throw std::invalid_argument("Unsupported oversampling factor " +
+                                  std::to_string(factor));
+    }
+    for (auto &chain : inputs_up) {
+      chain.stages.resize(num_stages);
+      chain.buffers.resize(num_stages);
+    }
+    for (auto &chain : outputs_down) {
+      chain.stages.resize(num_stages);
+      chain.buffers.resize(num_stages);
+    }
+  }
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  // The wrapped DSP, for controls specific to its type
+  DSP &get_dsp() const { return *dsp; }
+  int get_factor() const { return factor; }
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override {
+    max_block = max_frames;
+    // Stage s runs from 2^s to 2^(s + 1) times the host rate
+    for (auto &chain : inputs_up) {
+      for (int s = 0; s < num_stages; ++s) {
+        chain.stages[s].prepare(static_cast<size_t>(max_frames) << s);
+        chain.buffers[s].assign(static_cast<size_t>(max_frames) << (s + 1),
+                                0.0f);
+      }
+    }
+    for (auto &chain : outputs_down) {
+      for (int s = 0; s < num_stages; ++s) {
+        chain.stages[s].prepare(static_cast<size_t>(max_frames) << s);
+        chain.buffers[s].assign(static_cast<size_t>(max_frames) << (s + 1),
+                                0.0f);
+      }
+    }
+    for (size_t ch = 0; ch < inputs_up.size(); ++ch) {
+      stage_inputs[ch] = inputs_up[ch].buffers.back().data();
+    }
+    for (size_t ch = 0; ch < outputs_down.size(); ++ch) {
+      stage_outputs[ch] = outputs_down[ch].buffers.back().data();
+    }
+    dsp->prepare(sample_rate * factor, max_frames * factor);
+  }
+
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double sample_rate) override {
+    if (max_block == 0) {
+      for (size_t ch = 0; ch < outputs_down.size(); ++ch) {
+        std::fill_n(outputs[ch], nframes, 0.0f);
+      }
+      return;
+    }
+    // Blocks larger than the prepared size are processed in slices
+    for (jack_nframes_t offset = 0; offset < nframes; offset += max_block) {
+      const jack_nframes_t frames = std::min(max_block, nframes - offset);
+      for (size_t ch = 0; ch < inputs_up.size(); ++ch) {
+        const float *in = inputs[ch] + offset;
+        Chain<HalfBandUpsampler> &chain = inputs_up[ch];
+        for (int s = 0; s < num_stages; ++s) {
+          chain.stages[s].process(in, static_cast<size_t>(frames) << s,
+                                  chain.buffers[s].data());
+          in = chain.buffers[s].data();
+        }
+      }
+      dsp->process_audio(frames * factor, stage_inputs.data(),
+                         stage_outputs.data(), sample_rate * factor);
+      for (size_t ch = 0; ch < outputs_down.size(); ++ch) {
+        Chain<HalfBandDownsampler> &chain = outputs_down[ch];
+        for (int s = num_stages - 1; s >= 0; --s) {
+          float *out =
+              s > 0 ? chain.buffers[s - 1].data() : outputs[ch] + offset;
+          chain.stages[s].process(chain.buffers[s].data(),
+                                  static_cast<size_t>(frames) << s, out);
+        }
+      }
+    }
+  }
+
+  int get_num_inputs() const override { return dsp->get_num_inputs(); }
+  int get_num_outputs() const override { return dsp->get_num_outputs(); }
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return dsp->get_parameter_descriptors();
+  }
+  void set_parameter(ParameterId id, const ParameterValue &value) override {
+    dsp->set_parameter(id, value);
+  }
+  ParameterValue get_parameter(ParameterId id) const override {
+    return dsp->get_parameter(id);
+  }
+
+  void note_on(int note, float velocity) override {
+    dsp->note_on(note, velocity);
+  }
+  void note_off(int note) override { dsp->note_off(note); }
+  void flush_parameters() override { dsp->flush_parameters(); }
+  void reset_smoothing() override { dsp->reset_smoothing(); }
+
+  // Events are applied between the host-rate pieces process_events splits
+  // the block into, so they stay sample-accurate at the host rate
+  bool receives_midi() const override { return dsp->receives_midi(); }
+  void handle_event(const MidiEvent &event) override {
+    dsp->handle_event(event);
+  }
+
+  VoiceUsage get_voice_usage() const override {
+    return dsp->get_voice_usage();
+  }
+
+  // Each stage delays by 2 * PAIRS - 1/2 samples at its lower rate, up and
+  // down together; the wrapped DSP's own latency is at the higher rate
+  jack_nframes_t get_latency() const override {
+    double frames = static_cast<double>(dsp->get_latency()) / factor;
+    for (int s = 0; s < num_stages; ++s) {
+      frames += (2.0 * HalfBandFilter::PAIRS - 0.5) / (1 << s);
+    }
+    return static_cast<jack_nframes_t>(std::lround(frames));
+  }
+
+private:
+  // One channel's stages, each with the buffer it writes at its higher rate
+  template <typename Stage> struct Chain {
+    std::vector<Stage> stages;
+    std::vector<std::vector<float>> buffers;
+  };
+
+  std::unique_ptr<DSP> dsp;
+  int factor;
+  int num_stages;
+  jack_nframes_t max_block = 0;
+  std::vector<Chain<HalfBandUpsampler>> inputs_up;
+  std::vector<Chain<HalfBandDownsampler>> outputs_down;
+  // The wrapped DSP's buffers, at the oversampled rate
+  std::vector<float *> stage_inputs;
+  std::vector<float *> stage_outputs;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "dsp.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Control-side parameter values of one DSP, with the version each last
+// changed at.
+//
+// Edits are staged with set() and reach the DSP together in commit(), so a
+// slider dragged through many events in one GUI frame, or a burst of
+// remote updates, costs the DSP one set_parameter per changed parameter
+// per frame rather than one per event. commit() stamps what it sends with
+// a version, and for_each_changed_since() walks what a reader last in sync
+// at an older version has missed. Control thread only.
+class ParameterStore {
+public:
+  // Starts over from the DSP's current values, all stamped with version
+  void reset(const DSP &dsp, uint64_t version) {
+    values.clear();
+    for (const auto &descriptor : dsp.get_parameter_descriptors()) {
+      values.push_back(dsp.get_parameter(descriptor.id));
+    }
+    versions.assign(values.size(), version);
+    staged.assign(values.size(), false);
+    staged_ids.clear();
+  }
+
+  size_t size() const { return values.size(); }
+
+  // Latest value, staged or committed
+  const ParameterValue &get(ParameterId id) const { return values[id]; }
+
+  // Replaces any value staged for id since the last commit
+  void set(ParameterId id, ParameterValue value) {
+    if (id >= values.size()) {
+      return;
+    }
+    values[id] = std::move(value);
+    if (!staged[id]) {
+      staged[id] = true;
+      staged_ids.push_back(id);
+    }
+  }
+
+  bool has_staged() const { return !staged_ids.empty(); }
+
+  // Hands every staged value to dsp and stamps it with version
+  void commit(DSP &dsp, uint64_t version) {
+    for (ParameterId id : staged_ids) {
+      dsp.set_parameter(id, values[id]);
+      versions[id] = version;
+      staged[id] = false;
+    }
+    staged_ids.clear();
+  }
+
+  // Calls fn(id, value, version) for every parameter committed after
+  // version, in id order
+  template <typename Fn>
+  void for_each_changed_since(uint64_t version, Fn &&fn) const {
+    for (ParameterId id = 0; id < values.size(); ++id) {
+      if (versions[id] > version) {
+        fn(id, values[id], versions[id]);
+      }
+    }
+  }
+
+private:
+  std::vector<ParameterValue> values;
+  std::vector<uint64_t> versions;
+  // Staged since the last commit, with staged_ids in first-set order
+  std::vector<bool> staged;
+  std::vector<ParameterId> staged_ids;
+};
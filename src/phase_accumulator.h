@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Phase accumulators for BasicOscillator, in cycles.
+//
+// The running phase is kept between vectors, and the sample loop gets it
+// as a float from get() and adds the lane offsets in float, so the loop only
+// uses full-width float vectors. An accumulator provides:
+//
+//   Increment                      per-sample advance, in its own units
+//   to_increment(double cycles)    converts an advance in cycles
+//   to_cycles(Increment)           and back, as a float for the lanes
+//   get()                          phase in [0, 1)
+//   advance(Increment)             steps the phase, wrapping into [0, 1)
+//   get_cycles()                   phase as a double, for checks
+
+// 32-bit fixed point: one cycle is 2^32, so the phase wraps by integer
+// overflow with no floor or branch and never loses precision however long
+// it runs. Pitch resolution is sample_rate / 2^32, about 1e-5 Hz at 48 kHz,
+// and a constant increment of k / 2^32 cycles repeats exactly.
+class FixedPointPhase {
+public:
+  // Signed, so frequency ramps can fall
+  using Increment = int64_t;
+
+  static Increment to_increment(double cycles) {
+    return static_cast<Increment>(std::llround(cycles * 0x1p32));
+  }
+  static float to_cycles(Increment increment) {
+    return static_cast<float>(increment) * 0x1p-32f;
+  }
+
+  // The top 24 bits, which a float holds exactly
+  float get() const { return static_cast<float>(phase >> 8) * 0x1p-24f; }
+  void advance(Increment increment) {
+    phase += static_cast<uint32_t>(increment);
+  }
+  double get_cycles() const { return phase * 0x1p-32; }
+
+private:
+  uint32_t phase = 0;
+};
+
+// Float, renormalized into [0, 1) after every advance so its resolution
+// stays at 2^-24 cycles instead of decaying as the phase grows. Each
+// advance rounds, so the pitch error is bounded but the phase error, unlike
+// FixedPointPhase's, grows with time.
+class FloatPhase {
+public:
+  using Increment = float;
+
+  static Increment to_increment(double cycles) {
+    return static_cast<Increment>(cycles);
+  }
+  static float to_cycles(Increment increment) { return increment; }
+
+  float get() const { return phase; }
+  void advance(Increment increment) {
+    phase += increment;
+    phase -= std::floor(phase);
+  }
+  double get_cycles() const { return phase; }
+
+private:
+  float phase = 0.0f;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "dsp.h"
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Pitched DSP Class
+//
+// Adds a "frequency" parameter to a DSP whose pitch is spread over several
+// frequency parameters, such as a graph of detuned oscillators, and sets
+// each of them to the new frequency times its ratio. PolyphonicDSP tunes
+// voices through that parameter, so wrapped types follow the notes played.
+// The wrapped DSP's own parameters keep their ids, and everything else is
+// forwarded unchanged.
+class PitchedDSP : public DSP {
+public:
+  // Frequency parameter of the wrapped DSP, and its ratio to the root
+  struct Target {
+    std::string parameter;
+    float ratio;
+  };
+
+  // Throws std::invalid_argument if a target is not a parameter of dsp
+  PitchedDSP(std::unique_ptr<DSP> dsp, const std::vector<Target> &targets)
+      : dsp(std::move(dsp)),
+        descriptors(this->dsp->get_parameter_descriptors()) {
+    for (const Target &target : targets) {
+      const ParameterId id = this->dsp->find_parameter(target.parameter);
+      if (id == INVALID_PARAMETER) {
+        throw std::invalid_argument("No parameter " + target.parameter);
+      }
+      resolved.push_back({id, target.ratio});
+    }
+    frequency_id = static_cast<ParameterId>(descriptors.size());
+    descriptors.push_back({frequency_id, "frequency", ParameterType::Float,
+                           20.0f, 20000.0f, DEFAULT_FREQUENCY});
+    set_parameter(frequency_id, DEFAULT_FREQUENCY);
+  }
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  DSP &get_dsp() const { return *dsp; }
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return descriptors;
+  }
+
+  // Real-time safe when the wrapped DSP's set_parameter is
+  void set_parameter(ParameterId id, const ParameterValue &value) override {
+    if (id != frequency_id) {
+      dsp->set_parameter(id, value);
+      return;
+    }
+    const float root = parameter_as_float(value);
+    frequency.store(root, std::memory_order_relaxed);
+    for (const auto &[target, ratio] : resolved) {
+      dsp->set_parameter(target, root * ratio);
+    }
+  }
+
+  ParameterValue get_parameter(ParameterId id) const override {
+    if (id == frequency_id) {
+      return frequency.load(std::memory_order_relaxed);
+    }
+    return dsp->get_parameter(id);
+  }
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override {
+    dsp->prepare(sample_rate, max_frames);
+  }
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double sample_rate) override {
+    dsp->process_audio(nframes, inputs, outputs, sample_rate);
+  }
+  int get_num_inputs() const override { return dsp->get_num_inputs(); }
+  int get_num_outputs() const override { return dsp->get_num_outputs(); }
+
+  void note_on(int note, float velocity) override {
+    dsp->note_on(note, velocity);
+  }
+  void note_off(int note) override { dsp->note_off(note); }
+  void flush_parameters() override { dsp->flush_parameters(); }
+  void reset_smoothing() override { dsp->reset_smoothing(); }
+  bool receives_midi() const override { return dsp->receives_midi(); }
+  void handle_event(const MidiEvent &event) override {
+    dsp->handle_event(event);
+  }
+  VoiceUsage get_voice_usage() const override {
+    return dsp->get_voice_usage();
+  }
+  jack_nframes_t get_latency() const override { return dsp->get_latency(); }
+
+private:
+  std::unique_ptr<DSP> dsp;
+  std::vector<ParameterDescriptor> descriptors;
+  std::vector<std::pair<ParameterId, float>> resolved;
+  ParameterId frequency_id;
+  std::atomic<float> frequency{DEFAULT_FREQUENCY};
+};
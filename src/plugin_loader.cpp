@@ -0,0 +1,393 @@
+#include "plugin_loader.h"
+
+#include "dearjack_plugin.h"
+#include "dsp.h"
+#include "dsp_factory.h"
+#include "spsc_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// What every instance of a plugin type shares. Holding the library handle
+// keeps the plugin's code loaded for as long as any of them lives.
+struct PluginType {
+  std::shared_ptr<void> library;
+  const DearJackDSPType *type;
+  std::vector<ParameterDescriptor> descriptors;
+};
+
+// Hosts one instance of a plugin type behind the DSP interface.
+//
+// Parameter values are published through atomics and notes through a
+// wait-free queue, and both are handed to the plugin at the start of the
+// next block, so the plugin only ever sees them on the audio thread.
+class PluginDSP : public DSP {
+public:
+  explicit PluginDSP(std::shared_ptr<const PluginType> plugin_type)
+      : plugin_type(std::move(plugin_type)),
+        type(*this->plugin_type->type),
+        num_parameters(this->plugin_type->descriptors.size()),
+        values(new std::atomic<float>[num_parameters]),
+        // NaN compares unequal to everything, so every value is sent
+        // before the first block
+        applied(num_parameters, std::numeric_limits<float>::quiet_NaN()),
+        slice_inputs(type.num_inputs), slice_outputs(type.num_outputs) {
+    for (size_t id = 0; id < num_parameters; ++id) {
+      values[id].store(this->plugin_type->descriptors[id].default_value);
+    }
+    instance = type.create();
+    if (!instance) {
+      throw std::runtime_error(std::string("Plugin type ") + type.name +
+                               " failed to create an instance");
+    }
+  }
+
+  ~PluginDSP() override { type.destroy(instance); }
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return plugin_type->descriptors;
+  }
+
+  void set_parameter(ParameterId id, const ParameterValue &value) override {
+    if (id >= num_parameters) {
+      return;
+    }
+    float number = parameter_as_float(value);
+    if (plugin_type->descriptors[id].type == ParameterType::Int) {
+      number = std::round(number);
+    }
+    values[id].store(number, std::memory_order_relaxed);
+  }
+
+  ParameterValue get_parameter(ParameterId id) const override {
+    if (id >= num_parameters) {
+      throw std::runtime_error("Unknown parameter id: " + std::to_string(id));
+    }
+    const float number = values[id].load(std::memory_order_relaxed);
+    if (plugin_type->descriptors[id].type == ParameterType::Int) {
+      return static_cast<int>(number);
+    }
+    return number;
+  }
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override {
+    max_block = max_frames;
+    if (type.prepare) {
+      type.prepare(instance, sample_rate, max_frames);
+    }
+  }
+
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double) override {
+    for (size_t id = 0; id < num_parameters; ++id) {
+      const float value = values[id].load(std::memory_order_relaxed);
+      if (value != applied[id]) {
+        applied[id] = value;
+        type.set_parameter(instance, static_cast<uint32_t>(id), value);
+      }
+    }
+    note_events.consume_all([this](const NoteEvent &event) {
+      apply_note(event.note, event.velocity);
+    });
+
+    if (max_block == 0) {
+      for (size_t ch = 0; ch < slice_outputs.size(); ++ch) {
+        std::fill_n(outputs[ch], nframes, 0.0f);
+      }
+      return;
+    }
+    // Blocks larger than the prepared size are processed in slices
+    for (jack_nframes_t offset = 0; offset < nframes; offset += max_block) {
+      const jack_nframes_t frames = std::min(max_block, nframes - offset);
+      for (size_t ch = 0; ch < slice_inputs.size(); ++ch) {
+        slice_inputs[ch] = inputs[ch] + offset;
+      }
+      for (size_t ch = 0; ch < slice_outputs.size(); ++ch) {
+        slice_outputs[ch] = outputs[ch] + offset;
+      }
+      type.process(instance, frames, slice_inputs.data(),
+                   slice_outputs.data());
+    }
+  }
+
+  int get_num_inputs() const override {
+    return static_cast<int>(type.num_inputs);
+  }
+  int get_num_outputs() const override {
+    return static_cast<int>(type.num_outputs);
+  }
+
+  void note_on(int note, float velocity) override {
+    if (is_polyphonic()) {
+      note_events.try_push(NoteEvent{note, std::clamp(velocity, 0.0f, 1.0f)});
+    }
+  }
+  void note_off(int note) override {
+    if (is_polyphonic()) {
+      note_events.try_push(NoteEvent{note, 0.0f});
+    }
+  }
+
+  bool receives_midi() const override { return is_polyphonic(); }
+  void handle_event(const MidiEvent &event) override {
+    if (is_polyphonic()) {
+      apply_note(event.note, event.type == MidiEvent::Type::NoteOn
+                                 ? event.velocity
+                                 : 0.0f);
+    }
+  }
+
+  jack_nframes_t get_latency() const override { return type.latency; }
+
+private:
+  // Note-on with velocity > 0, note-off otherwise
+  struct NoteEvent {
+    int note = 0;
+    float velocity = 0.0f;
+  };
+
+  bool is_polyphonic() const {
+    return (type.flags & DEARJACK_DSP_POLYPHONIC) != 0;
+  }
+
+  // Audio thread only
+  void apply_note(int note, float velocity) {
+    if (velocity > 0.0f) {
+      type.note_on(instance, note, velocity);
+    } else {
+      type.note_off(instance, note);
+    }
+  }
+
+  // Declared first so the plugin stays loaded until the instance is gone
+  std::shared_ptr<const PluginType> plugin_type;
+  const DearJackDSPType &type;
+  void *instance = nullptr;
+  size_t num_parameters;
+  // Control side values, and what the plugin was last given
+  std::unique_ptr<std::atomic<float>[]> values;
+  std::vector<float> applied;
+  SPSCQueue<NoteEvent, 256> note_events;
+  jack_nframes_t max_block = 0;
+  std::vector<const float *> slice_inputs;
+  std::vector<float *> slice_outputs;
+};
+
+// Why a plugin's type cannot be hosted, or nullptr if it can
+const char *check_type(const DearJackDSPType &type) {
+  if (!type.name || !*type.name) {
+    return "it has no name";
+  }
+  if (!type.create || !type.destroy || !type.process) {
+    return "create, destroy or process is missing";
+  }
+  if (type.num_parameters > 0 && (!type.parameters || !type.set_parameter)) {
+    return "its parameters or set_parameter are missing";
+  }
+  for (uint32_t id = 0; id < type.num_parameters; ++id) {
+    if (!type.parameters[id].name) {
+      return "a parameter has no name";
+    }
+  }
+  if ((type.flags & DEARJACK_DSP_POLYPHONIC) &&
+      (!type.note_on || !type.note_off)) {
+    return "it is polyphonic without note_on and note_off";
+  }
+  return nullptr;
+}
+
+std::vector<ParameterDescriptor> make_descriptors(const DearJackDSPType &type) {
+  std::vector<ParameterDescriptor> descriptors;
+  for (uint32_t id = 0; id < type.num_parameters; ++id) {
+    const DearJackParameter &parameter = type.parameters[id];
+    descriptors.push_back({id, parameter.name,
+                           parameter.type == DEARJACK_PARAMETER_INT
+                               ? ParameterType::Int
+                               : ParameterType::Float,
+                           parameter.min_value, parameter.max_value,
+                           parameter.default_value});
+  }
+  return descriptors;
+}
+
+} // namespace
+
+PluginLoader::PluginLoader(std::string directory)
+    : directory(std::move(directory)) {}
+
+PluginLoader::~PluginLoader() {
+  // The copies were unlinked once loaded, so this only removes the
+  // directory itself; loaded plugins stay mapped
+  if (!shadow_directory.empty()) {
+    std::error_code error;
+    fs::remove_all(shadow_directory, error);
+  }
+}
+
+PluginLoader::ScanResult PluginLoader::scan() {
+  ScanResult result;
+  std::unordered_set<std::string> present;
+  std::error_code error;
+  for (fs::directory_iterator it(directory, error), end; !error && it != end;
+       it.increment(error)) {
+    const fs::directory_entry &entry = *it;
+    std::error_code entry_error;
+    if (entry.path().extension() != ".so" ||
+        !entry.is_regular_file(entry_error)) {
+      continue;
+    }
+    const std::string path = entry.path().string();
+    present.insert(path);
+    const fs::file_time_type modified = entry.last_write_time(entry_error);
+    const uintmax_t size = entry.file_size(entry_error);
+    auto found = plugins.find(path);
+    if (found != plugins.end() && found->second.modified == modified &&
+        found->second.size == size) {
+      continue;
+    }
+    Plugin &plugin = plugins[path];
+    // A version that fails to load is not retried until it changes again
+    plugin.modified = modified;
+    plugin.size = size;
+    if (load(path, plugin)) {
+      ++result.loaded;
+    } else {
+      ++result.failed;
+    }
+  }
+
+  for (auto it = plugins.begin(); it != plugins.end();) {
+    if (present.count(it->first) != 0) {
+      ++it;
+      continue;
+    }
+    std::cerr << "Plugin " << it->first << " removed" << std::endl;
+    unregister_types(it->second.types);
+    it = plugins.erase(it);
+    ++result.removed;
+  }
+  return result;
+}
+
+std::vector<std::string> PluginLoader::get_types() const {
+  std::vector<std::string> types;
+  for (const auto &[type, _] : owners) {
+    types.push_back(type);
+  }
+  std::sort(types.begin(), types.end());
+  return types;
+}
+
+bool PluginLoader::load(const std::string &path, Plugin &plugin) {
+  // dlopen hands back the library it already has for a path it has loaded,
+  // so every version is loaded from a private copy of its own. The copy is
+  // unlinked once mapped, which also lets the original be overwritten while
+  // the old version is still running.
+  std::error_code error;
+  if (shadow_directory.empty()) {
+    std::string pattern =
+        (fs::temp_directory_path(error) / "dearjack-plugins-XXXXXX").string();
+    if (!mkdtemp(pattern.data())) {
+      std::cerr << "Cannot load plugin " << path
+                << ": no directory for private copies" << std::endl;
+      return false;
+    }
+    shadow_directory = pattern;
+  }
+  const fs::path copy =
+      fs::path(shadow_directory) /
+      (std::to_string(++generation) + "-" + fs::path(path).filename().string());
+  if (!fs::copy_file(path, copy, error)) {
+    std::cerr << "Cannot load plugin " << path << ": " << error.message()
+              << std::endl;
+    return false;
+  }
+  void *handle = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+  fs::remove(copy, error);
+  if (!handle) {
+    std::cerr << "Cannot load plugin " << path << ": " << dlerror()
+              << std::endl;
+    return false;
+  }
+  std::shared_ptr<void> library(handle, [](void *h) { dlclose(h); });
+
+  auto entry = reinterpret_cast<DearJackPluginEntry>(
+      dlsym(handle, DEARJACK_PLUGIN_ENTRY));
+  const DearJackPlugin *description = entry ? entry() : nullptr;
+  if (!description) {
+    std::cerr << "Cannot load plugin " << path << ": no "
+              << DEARJACK_PLUGIN_ENTRY << std::endl;
+    return false;
+  }
+  if (description->abi_version != DEARJACK_PLUGIN_ABI_VERSION) {
+    std::cerr << "Cannot load plugin " << path << ": built for plugin ABI "
+              << description->abi_version << ", this host has "
+              << DEARJACK_PLUGIN_ABI_VERSION << std::endl;
+    return false;
+  }
+
+  std::vector<std::string> types;
+  for (uint32_t t = 0; t < description->num_types; ++t) {
+    const DearJackDSPType &type = description->types[t];
+    if (const char *problem = check_type(type)) {
+      std::cerr << "Plugin " << path << ": skipping type " << t << ", "
+                << problem << std::endl;
+      continue;
+    }
+    const std::string name = type.name;
+    auto owner = owners.find(name);
+    const bool ours = owner != owners.end() && owner->second == path;
+    if (!ours && DSPFactory::instance().has_dsp(name)) {
+      std::cerr << "Plugin " << path << ": skipping type " << name
+                << ", which is already registered" << std::endl;
+      continue;
+    }
+    auto shared = std::make_shared<const PluginType>(
+        PluginType{library, &type, make_descriptors(type)});
+    DSPFactory::instance().register_dsp(
+        name,
+        [shared]() -> std::unique_ptr<DSP> {
+          return std::make_unique<PluginDSP>(shared);
+        },
+        (type.flags & DEARJACK_DSP_POLYPHONIC) != 0);
+    owners[name] = path;
+    types.push_back(name);
+  }
+
+  // Types the new version no longer has
+  std::vector<std::string> dropped;
+  for (const std::string &name : plugin.types) {
+    if (std::find(types.begin(), types.end(), name) == types.end()) {
+      dropped.push_back(name);
+    }
+  }
+  unregister_types(dropped);
+  plugin.types = std::move(types);
+  std::cerr << "Loaded plugin " << path << " with " << plugin.types.size()
+            << " DSP type(s)" << std::endl;
+  return true;
+}
+
+void PluginLoader::unregister_types(const std::vector<std::string> &types) {
+  for (const std::string &name : types) {
+    DSPFactory::instance().unregister_dsp(name);
+    owners.erase(name);
+  }
+}
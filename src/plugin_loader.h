@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Loads DSP plugins (see dearjack_plugin.h) from one directory into the
+// DSPFactory.
+//
+// scan() loads every shared object that is new or has changed since the
+// last scan and unregisters the types of plugins whose files have gone. A
+// reloaded plugin's types replace the previous version's, so new instances
+// and hot swaps get the new code while running instances keep theirs; each
+// version stays loaded until the last DSP made from it is destroyed. A scan
+// never touches the process callback, so it is safe with clients running.
+class PluginLoader {
+public:
+  struct ScanResult {
+    size_t loaded = 0;  // Plugins loaded for the first time or reloaded
+    size_t removed = 0; // Plugins whose files are gone
+    size_t failed = 0;  // Plugins that could not be loaded
+  };
+
+  explicit PluginLoader(std::string directory);
+  ~PluginLoader();
+
+  PluginLoader(const PluginLoader &) = delete;
+  PluginLoader &operator=(const PluginLoader &) = delete;
+
+  // Control thread only. A missing directory counts as empty.
+  ScanResult scan();
+
+  const std::string &get_directory() const { return directory; }
+  // Control thread only. DSP types registered by the loaded plugins.
+  std::vector<std::string> get_types() const;
+
+private:
+  struct Plugin {
+    std::filesystem::file_time_type modified;
+    uintmax_t size = 0;
+    std::vector<std::string> types;
+  };
+
+  // Loads the current version of the plugin at path into plugin, keeping
+  // its previous types if the new version fails
+  bool load(const std::string &path, Plugin &plugin);
+  void unregister_types(const std::vector<std::string> &types);
+
+  std::string directory;
+  std::unordered_map<std::string, Plugin> plugins; // By path
+  std::unordered_map<std::string, std::string> owners; // Type to path
+  // Private copies are loaded from here; see load
+  std::string shadow_directory;
+  uint64_t generation = 0;
+};
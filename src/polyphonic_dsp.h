@@ -0,0 +1,419 @@
+#pragma once
+
+#include "dsp.h"
+#include "simd.h"
+#include "spsc_queue.h"
+#include "thread_manager.h"
+#include "voice_allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Polyphonic DSP Class
+//
+// Parameter changes and notes are made from a single control thread (the
+// GUI) and are handed to the audio thread through wait-free queues, applied
+// at the start of the next block. The control thread reads back its own
+// snapshot of the values it has published, so neither thread ever waits on
+// the other.
+//
+// Voices are allocated per note by a VoiceAllocator and only sounding voices
+// are rendered, so a large pool costs nothing while idle. Each voice fades in
+// and out over a few milliseconds so that allocation never clicks.
+class PolyphonicDSP : public DSP {
+public:
+  using StealPolicy = VoiceAllocator::StealPolicy;
+
+  // Throws std::invalid_argument if num_voices < 1
+  PolyphonicDSP(std::function<std::unique_ptr<DSP>()> create_dsp,
+                int num_voices)
+      : create_dsp(std::move(create_dsp)),
+        voices(checked_voice_count(num_voices)),
+        allocator(num_voices), envelopes(num_voices) {
+    for (auto &voice : voices) {
+      voice = this->create_dsp();
+    }
+
+    num_inputs = voices[0]->get_num_inputs();
+    num_outputs = voices[0]->get_num_outputs();
+    descriptors = voices[0]->get_parameter_descriptors();
+    for (const auto &descriptor : descriptors) {
+      parameter_values.push_back(voices[0]->get_parameter(descriptor.id));
+    }
+    pending_changes.resize(descriptors.size());
+    frequency_parameter = voices[0]->find_parameter("frequency");
+    active_voices.reserve(voices.size());
+  }
+
+  using DSP::get_parameter;
+  using DSP::set_parameter;
+
+  const std::vector<ParameterDescriptor> &
+  get_parameter_descriptors() const override {
+    return descriptors;
+  }
+
+  // Sets the parameter on every voice
+  void set_parameter(ParameterId id, const ParameterValue &value) override {
+    if (id >= descriptors.size()) {
+      return;
+    }
+    parameter_values[id] = value;
+    flush_pending_changes();
+    if (!parameter_changes.try_push(ParameterChange{id, ALL_VOICES, value})) {
+      // Queue full: keep the latest value and retry on the next call or
+      // flush_parameters
+      pending_changes[id] = true;
+      has_pending_changes = true;
+    }
+  }
+
+  // Sets the parameter on one voice only, until the next set_parameter for
+  // the same id. Returns false if the queue is full.
+  bool set_voice_parameter(int voice, ParameterId id,
+                           const ParameterValue &value) {
+    if (id >= descriptors.size() || voice < 0 ||
+        voice >= static_cast<int>(voices.size())) {
+      return false;
+    }
+    flush_pending_changes();
+    return parameter_changes.try_push(ParameterChange{id, voice, value});
+  }
+
+  ParameterValue get_parameter(ParameterId id) const override {
+    if (id >= descriptors.size()) {
+      throw std::runtime_error("Unknown parameter id: " + std::to_string(id));
+    }
+    return parameter_values[id];
+  }
+
+  void flush_parameters() override { flush_pending_changes(); }
+
+  void note_on(int note, float velocity) override {
+    note_events.try_push(NoteEvent{note, std::clamp(velocity, 0.0f, 1.0f)});
+  }
+
+  void note_off(int note) override {
+    note_events.try_push(NoteEvent{note, 0.0f});
+  }
+
+  // MIDI notes start and stop voices directly on the audio thread
+  bool receives_midi() const override { return true; }
+  void handle_event(const MidiEvent &event) override {
+    if (event.type == MidiEvent::Type::NoteOn) {
+      start_note(event.note, event.velocity);
+    } else {
+      release_note(event.note);
+    }
+  }
+
+  void set_steal_policy(StealPolicy policy) {
+    steal_policy.store(policy, std::memory_order_relaxed);
+  }
+  StealPolicy get_steal_policy() const {
+    return steal_policy.load(std::memory_order_relaxed);
+  }
+
+  size_t get_num_voices() const { return voices.size(); }
+  // Voices rendered in the last block
+  size_t get_num_active_voices() const {
+    return active_count.load(std::memory_order_relaxed);
+  }
+
+  VoiceUsage get_voice_usage() const override {
+    return {static_cast<uint32_t>(active_voices.size()),
+            static_cast<uint32_t>(voices.size())};
+  }
+
+  void prepare(double sample_rate, jack_nframes_t max_frames) override {
+    max_block = max_frames;
+    envelope_step = static_cast<float>(1.0 / (FADE_SECONDS * sample_rate));
+    voice_inputs.assign(num_inputs, nullptr);
+
+    // One scratch lane per fork/join participant; lane 0 doubles as the
+    // serial path's scratch
+    const size_t lane_size = static_cast<size_t>(num_outputs) * max_frames;
+    lanes.resize(ThreadManager::num_participants());
+    for (auto &lane : lanes) {
+      lane.scratch.assign(lane_size, 0.0f);
+      lane.mix.assign(lane_size, 0.0f);
+      lane.outputs.resize(num_outputs);
+      for (int ch = 0; ch < num_outputs; ++ch) {
+        lane.outputs[ch] = lane.scratch.data() + ch * max_frames;
+      }
+    }
+
+    for (auto &voice : voices) {
+      voice->prepare(sample_rate, max_frames);
+    }
+  }
+
+  // Minimum voices * frames in a slice before voices are rendered on the
+  // worker pool; below it the fork/join overhead outweighs the gain.
+  // SIZE_MAX keeps rendering serial.
+  void set_parallel_threshold(size_t voice_frames) {
+    parallel_threshold.store(voice_frames, std::memory_order_relaxed);
+  }
+
+  void process_audio(jack_nframes_t nframes, float **inputs, float **outputs,
+                     double sample_rate) override {
+    parameter_changes.consume_all([this](const ParameterChange &change) {
+      if (change.voice != ALL_VOICES) {
+        voices[change.voice]->set_parameter(change.id, change.value);
+        return;
+      }
+      for (auto &voice : voices) {
+        voice->set_parameter(change.id, change.value);
+      }
+    });
+
+    note_events.consume_all([this](const NoteEvent &event) {
+      if (event.velocity > 0.0f) {
+        start_note(event.note, event.velocity);
+      } else {
+        release_note(event.note);
+      }
+    });
+
+    for (int ch = 0; ch < num_outputs; ++ch) {
+      std::fill_n(outputs[ch], nframes, 0.0f);
+    }
+
+    active_voices.clear();
+    for (unsigned v = 0; v < voices.size(); ++v) {
+      if (!allocator.is_idle(v)) {
+        active_voices.push_back(v);
+      }
+    }
+    active_count.store(active_voices.size(), std::memory_order_relaxed);
+    if (max_block == 0 || active_voices.empty()) {
+      return;
+    }
+
+    // Render the sounding voices into the preallocated scratch buffers and
+    // sum them. Blocks larger than the prepared size are processed in
+    // slices.
+    for (jack_nframes_t offset = 0; offset < nframes; offset += max_block) {
+      const jack_nframes_t frames = std::min(max_block, nframes - offset);
+      for (int ch = 0; ch < num_inputs; ++ch) {
+        voice_inputs[ch] = inputs[ch] + offset;
+      }
+
+      if (render_parallel(frames, sample_rate)) {
+        for (const auto &lane : lanes) {
+          if (!lane.used) {
+            continue;
+          }
+          for (int ch = 0; ch < num_outputs; ++ch) {
+            simd::add_to(outputs[ch] + offset, lane.mix.data() + ch * max_block,
+                         frames);
+          }
+        }
+        continue;
+      }
+
+      Lane &lane = lanes[0];
+      for (unsigned v : active_voices) {
+        voices[v]->process_audio(frames, voice_inputs.data(),
+                                 lane.outputs.data(), sample_rate);
+        apply_envelope(v, lane.outputs.data(), frames);
+        for (int ch = 0; ch < num_outputs; ++ch) {
+          simd::add_to(outputs[ch] + offset, lane.outputs[ch], frames);
+        }
+      }
+    }
+  }
+
+  int get_num_inputs() const override { return num_inputs; }
+  int get_num_outputs() const override { return num_outputs; }
+
+private:
+  static constexpr int ALL_VOICES = -1;
+  // Attack and release time of the per-voice fade
+  static constexpr double FADE_SECONDS = 0.005;
+
+  struct ParameterChange {
+    ParameterId id = INVALID_PARAMETER;
+    int voice = ALL_VOICES;
+    ParameterValue value;
+  };
+
+  // Note-on with velocity > 0, note-off otherwise
+  struct NoteEvent {
+    int note = 0;
+    float velocity = 0.0f;
+  };
+
+  // Audio thread only
+  struct VoiceEnvelope {
+    float gain = 0.0f;   // Current fade level
+    float target = 0.0f; // Velocity while held, 0 while releasing
+  };
+
+  // Per-participant scratch for parallel rendering. Each participant sums
+  // the voices it renders into its own mix, so no two threads share a buffer.
+  struct alignas(64) Lane {
+    std::vector<float> scratch;
+    std::vector<float> mix;
+    std::vector<float *> outputs;
+    bool used = false;
+  };
+
+  // Audio thread. A stolen voice keeps its phase and fades from its current
+  // level, so the steal never jumps; a silent voice starts at the note's
+  // frequency rather than gliding to it.
+  void start_note(int note, float velocity) {
+    const unsigned v = allocator.allocate(
+        note, steal_policy.load(std::memory_order_relaxed));
+    envelopes[v].target = velocity;
+    if (frequency_parameter != INVALID_PARAMETER) {
+      voices[v]->set_parameter(frequency_parameter, note_to_frequency(note));
+    }
+    if (envelopes[v].gain == 0.0f) {
+      voices[v]->reset_smoothing();
+    }
+  }
+
+  void release_note(int note) {
+    allocator.release(note,
+                      [this](unsigned v) { envelopes[v].target = 0.0f; });
+  }
+
+  // Ramps the voice toward its target level and records its peak for the
+  // allocator. A released voice goes idle once it has faded out.
+  void apply_envelope(unsigned v, float **buffers, jack_nframes_t frames) {
+    VoiceEnvelope &envelope = envelopes[v];
+    float gain = envelope.gain;
+    float peak = 0.0f;
+    for (jack_nframes_t i = 0; i < frames; ++i) {
+      if (gain < envelope.target) {
+        gain = std::min(gain + envelope_step, envelope.target);
+      } else if (gain > envelope.target) {
+        gain = std::max(gain - envelope_step, envelope.target);
+      }
+      for (int ch = 0; ch < num_outputs; ++ch) {
+        buffers[ch][i] *= gain;
+      }
+      if (num_outputs > 0) {
+        peak = std::max(peak, std::abs(buffers[0][i]));
+      }
+    }
+    envelope.gain = gain;
+    allocator[v].level = peak;
+    if (allocator[v].stage == VoiceAllocator::Stage::Releasing &&
+        gain == 0.0f) {
+      allocator.finish(v);
+    }
+  }
+
+  // Fans the voices of one slice out over the ThreadManager pool. Returns
+  // false if the slice should be rendered serially instead.
+  bool render_parallel(jack_nframes_t frames, double sample_rate) {
+    const unsigned participants = ThreadManager::num_participants();
+    if (participants < 2 || active_voices.size() < 2 ||
+        lanes.size() < participants ||
+        static_cast<size_t>(frames) * active_voices.size() <
+            parallel_threshold.load(std::memory_order_relaxed)) {
+      return false;
+    }
+
+    slice_frames = frames;
+    slice_sample_rate = sample_rate;
+    for (auto &lane : lanes) {
+      lane.used = false;
+    }
+    return ThreadManager::try_parallel_for(
+        static_cast<unsigned>(active_voices.size()), render_voice, this);
+  }
+
+  static void render_voice(void *context, unsigned index,
+                           unsigned participant) {
+    auto *self = static_cast<PolyphonicDSP *>(context);
+    Lane &lane = self->lanes[participant];
+    const unsigned v = self->active_voices[index];
+    self->voices[v]->process_audio(self->slice_frames,
+                                   self->voice_inputs.data(),
+                                   lane.outputs.data(),
+                                   self->slice_sample_rate);
+    self->apply_envelope(v, lane.outputs.data(), self->slice_frames);
+    for (int ch = 0; ch < self->num_outputs; ++ch) {
+      float *mix = lane.mix.data() + ch * self->max_block;
+      if (lane.used) {
+        simd::add_to(mix, lane.outputs[ch], self->slice_frames);
+      } else {
+        std::copy_n(lane.outputs[ch], self->slice_frames, mix);
+      }
+    }
+    lane.used = true;
+  }
+
+  static size_t checked_voice_count(int num_voices) {
+    if (num_voices < 1) {
+      throw std::invalid_argument("A PolyphonicDSP needs at least one voice");
+    }
+    return static_cast<size_t>(num_voices);
+  }
+
+  // Control thread: retry changes that did not fit in the queue
+  void flush_pending_changes() {
+    if (!has_pending_changes) {
+      return;
+    }
+    has_pending_changes = false;
+    for (ParameterId id = 0; id < pending_changes.size(); ++id) {
+      if (!pending_changes[id]) {
+        continue;
+      }
+      if (parameter_changes.try_push(
+              ParameterChange{id, ALL_VOICES, parameter_values[id]})) {
+        pending_changes[id] = false;
+      } else {
+        has_pending_changes = true;
+      }
+    }
+  }
+
+  std::function<std::unique_ptr<DSP>()> create_dsp;
+  std::vector<std::unique_ptr<DSP>> voices;
+
+  // Fixed after construction, safe to read from any thread
+  int num_inputs = 0;
+  int num_outputs = 0;
+  std::vector<ParameterDescriptor> descriptors;
+  ParameterId frequency_parameter = INVALID_PARAMETER;
+
+  // Control thread state, indexed by ParameterId
+  std::vector<ParameterValue> parameter_values;
+  std::vector<bool> pending_changes;
+  bool has_pending_changes = false;
+
+  // Control thread -> audio thread
+  SPSCQueue<ParameterChange, 256> parameter_changes;
+  SPSCQueue<NoteEvent, 256> note_events;
+  std::atomic<StealPolicy> steal_policy{StealPolicy::Oldest};
+
+  // Audio thread voice allocation
+  VoiceAllocator allocator;
+  std::vector<VoiceEnvelope> envelopes;
+  std::vector<unsigned> active_voices; // Reserved to the pool size
+  float envelope_step = 0.0f;
+  std::atomic<size_t> active_count{0};
+
+  // Scratch memory sized by prepare, never touched by the heap
+  // while processing
+  jack_nframes_t max_block = 0;
+  std::vector<float *> voice_inputs;
+  std::vector<Lane> lanes;
+
+  // Slice being rendered by the parallel path, set by the audio thread
+  // before dispatch
+  jack_nframes_t slice_frames = 0;
+  double slice_sample_rate = 0.0;
+  std::atomic<size_t> parallel_threshold{8192};
+};
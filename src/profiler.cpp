@@ -0,0 +1,38 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <bit>
+
+bool BlockProfiler::update() {
+  const size_t drained = samples.consume_all([this](uint32_t ns) {
+    if (window.size() < WINDOW) {
+      window.push_back(ns);
+    } else {
+      window[window_next] = ns;
+      window_next = (window_next + 1) % WINDOW;
+    }
+  });
+  stats.blocks += drained;
+  stats.dropped = dropped.load(std::memory_order_relaxed);
+  if (drained == 0 || window.empty()) {
+    return false;
+  }
+
+  histogram.fill(0.0f);
+  uint64_t total = 0;
+  for (uint32_t ns : window) {
+    total += ns;
+    const size_t bucket = ns == 0 ? 0 : std::bit_width(ns) - 1;
+    histogram[std::min(bucket, BUCKETS - 1)] += 1.0f;
+  }
+
+  sorted = window;
+  const size_t p99 = sorted.size() * 99 / 100;
+  std::nth_element(sorted.begin(), sorted.begin() + p99, sorted.end());
+  const auto [min, max] = std::minmax_element(window.begin(), window.end());
+  stats.min_us = *min * 1e-3;
+  stats.max_us = *max * 1e-3;
+  stats.p99_us = sorted[p99] * 1e-3;
+  stats.avg_us = static_cast<double>(total) / window.size() * 1e-3;
+  return true;
+}
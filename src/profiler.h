@@ -0,0 +1,62 @@
+#pragma once
+
+#include "spsc_queue.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Timing of one DSP's process calls.
+//
+// The audio thread records each block's duration into a wait-free ring with
+// record(); update() on the control thread drains it into statistics over
+// the last WINDOW blocks and a log2 histogram of durations. A full ring
+// drops samples rather than blocking, and the drops are counted.
+class BlockProfiler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  // Blocks the statistics are computed over
+  static constexpr size_t WINDOW = 2048;
+  // Histogram bucket b counts durations in [2^b, 2^(b + 1)) ns
+  static constexpr size_t BUCKETS = 32;
+
+  struct Stats {
+    double min_us = 0.0;
+    double avg_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+    uint64_t blocks = 0;  // Recorded since construction
+    uint64_t dropped = 0; // Lost to a full ring
+  };
+
+  // Audio thread. Real-time safe.
+  void record(clock::time_point start, clock::time_point end) {
+    const auto ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    if (!samples.try_push(static_cast<uint32_t>(ns.count()))) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Control thread. Drains the ring and recomputes the statistics; returns
+  // false if no block was recorded since the last call.
+  bool update();
+
+  // Control thread, as of the last update()
+  const Stats &get_stats() const { return stats; }
+  const std::array<float, BUCKETS> &get_histogram() const { return histogram; }
+
+private:
+  SPSCQueue<uint32_t, 4096> samples; // Durations in ns
+  std::atomic<uint64_t> dropped{0};
+
+  // Control thread
+  std::vector<uint32_t> window; // Ring of the last WINDOW durations in ns
+  size_t window_next = 0;
+  std::vector<uint32_t> sorted; // Scratch for the percentile
+  std::array<float, BUCKETS> histogram{};
+  Stats stats;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Single-reader read-copy-update cell.
+//
+// The control thread publishes immutable snapshots and the real-time thread
+// picks up the newest one with read(), which never locks, allocates or
+// frees. A replaced snapshot is kept until the reader has called read()
+// again after the swap, at which point it can no longer be holding the old
+// pointer, and collect() then frees it on the control thread.
+template <typename T> class RcuCell {
+public:
+  RcuCell() : RcuCell(std::make_unique<T>()) {}
+  explicit RcuCell(std::unique_ptr<T> initial)
+      : current_(initial.get()), owned_(std::move(initial)) {}
+
+  RcuCell(const RcuCell &) = delete;
+  RcuCell &operator=(const RcuCell &) = delete;
+
+  // Reader side. The snapshot stays valid until the next read().
+  const T *read() {
+    const uint64_t version = version_.load(std::memory_order_acquire);
+    const T *value = current_.load(std::memory_order_acquire);
+    reader_seen_.store(version, std::memory_order_release);
+    return value;
+  }
+
+  // Control side. The latest published snapshot.
+  const T &get() const { return *owned_; }
+
+  // Control side. Makes value the current snapshot and retires the previous
+  // one.
+  void publish(std::unique_ptr<T> value) {
+    publish(std::move(value), [](std::unique_ptr<T>) {});
+  }
+
+  // As publish(value), handing snapshots that are safe to free to
+  // dispose(std::unique_ptr<T>) instead of freeing them here
+  template <typename Dispose>
+  void publish(std::unique_ptr<T> value, Dispose &&dispose) {
+    const uint64_t version = version_.load(std::memory_order_relaxed) + 1;
+    current_.store(value.get(), std::memory_order_release);
+    version_.store(version, std::memory_order_release);
+    retired_.push_back({std::move(owned_), version});
+    owned_ = std::move(value);
+    collect(dispose);
+  }
+
+  // Control side. Frees the retired snapshots the reader has moved past and
+  // returns true when none are left.
+  bool collect() {
+    return collect([](std::unique_ptr<T>) {});
+  }
+
+  // As collect(), handing the snapshots to dispose(std::unique_ptr<T>)
+  template <typename Dispose> bool collect(Dispose &&dispose) {
+    const uint64_t seen = reader_seen_.load(std::memory_order_acquire);
+    for (auto it = retired_.begin(); it != retired_.end();) {
+      if (it->version <= seen) {
+        dispose(std::move(it->value));
+        it = retired_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return retired_.empty();
+  }
+
+  // Control side. Frees every retired snapshot; only valid once the reader
+  // has stopped for good.
+  void collect_all() { retired_.clear(); }
+
+private:
+  struct Retired {
+    std::unique_ptr<T> value;
+    uint64_t version; // First version that no longer refers to value
+  };
+
+  std::atomic<const T *> current_;
+  std::atomic<uint64_t> version_{0};
+  std::atomic<uint64_t> reader_seen_{0};
+  std::unique_ptr<T> owned_;
+  std::vector<Retired> retired_;
+};
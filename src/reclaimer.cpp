@@ -0,0 +1,83 @@
+#include "reclaimer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+std::mutex mutex;
+std::condition_variable work_available;
+std::condition_variable work_done;
+std::deque<std::function<void()>> queue;
+size_t pending = 0; // Queued plus running
+bool stopping = false;
+std::thread thread;
+
+void run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    work_available.wait(lock, [] { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    std::function<void()> work = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+    work();
+    work = nullptr; // Captures are destroyed off the lock too
+    lock.lock();
+    --pending;
+    work_done.notify_all();
+  }
+}
+
+} // namespace
+
+void Reclaimer::start() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (thread.joinable()) {
+    return;
+  }
+  stopping = false;
+  thread = std::thread(run);
+}
+
+void Reclaimer::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!thread.joinable()) {
+      return;
+    }
+    stopping = true;
+  }
+  work_available.notify_one();
+  thread.join();
+}
+
+void Reclaimer::post(std::function<void()> work) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (thread.joinable() && !stopping) {
+      queue.push_back(std::move(work));
+      ++pending;
+      work_available.notify_one();
+      return;
+    }
+  }
+  work();
+}
+
+void Reclaimer::drain() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!thread.joinable() || std::this_thread::get_id() == thread.get_id()) {
+    return;
+  }
+  work_done.wait(lock, [] { return pending == 0; });
+}
+
+size_t Reclaimer::get_pending() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending;
+}
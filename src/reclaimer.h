@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+
+// Background thread for slow control-side work: destroying objects the audio
+// thread has let go of (DSPs, instance lists, whole JACK clients) and
+// building their replacements.
+//
+// Neither the audio thread nor the GUI thread should pay for a destructor
+// that frees large buffers or closes a JACK client, so the control thread
+// hands such objects over with dispose(). Work runs in submission order on a
+// single thread at normal priority. Before start() and after shutdown(),
+// work runs on the calling thread.
+class Reclaimer {
+public:
+  static void start();
+  // Runs everything still queued, then stops the thread
+  static void shutdown();
+
+  // Queues work. Not real-time safe.
+  static void post(std::function<void()> work);
+
+  // Destroys object on the reclaimer thread
+  template <typename T> static void dispose(std::unique_ptr<T> object) {
+    if (object) {
+      post([raw = object.release()] { delete raw; });
+    }
+  }
+
+  // Waits until the queue is empty. Returns at once when called from queued
+  // work, since everything queued before it has already run.
+  static void drain();
+
+  // Work queued and not yet finished
+  static size_t get_pending();
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// Real-time safety helpers shared by the audio engine
+namespace rt {
+inline thread_local bool in_process_callback = false;
+
+// Marks the current thread as running a process callback for its lifetime
+class ProcessScope {
+public:
+  ProcessScope() noexcept { in_process_callback = true; }
+  ~ProcessScope() { in_process_callback = false; }
+  ProcessScope(const ProcessScope &) = delete;
+  ProcessScope &operator=(const ProcessScope &) = delete;
+};
+
+// Sets flush-to-zero and denormals-are-zero on the current thread for its
+// lifetime, restoring the previous mode afterwards.
+//
+// Decaying filters, envelopes and feedback paths end their tails in
+// subnormal floats, and most CPUs take a microcode assist on every operation
+// on one, 10-100x slower than normal math. With FTZ results that would be
+// subnormal become zero and with DAZ subnormal inputs read as zero, both far
+// below audibility. Every thread that runs DSP code holds one: the process
+// callback and the ThreadManager workers.
+class DenormalGuard {
+public:
+  DenormalGuard() noexcept : saved(read_mode()) {
+    write_mode(saved | FLUSH_BITS);
+  }
+  ~DenormalGuard() { write_mode(saved); }
+  DenormalGuard(const DenormalGuard &) = delete;
+  DenormalGuard &operator=(const DenormalGuard &) = delete;
+
+  // Whether the current thread flushes denormals
+  static bool active() noexcept {
+    return FLUSH_BITS != 0 && (read_mode() & FLUSH_BITS) == FLUSH_BITS;
+  }
+
+private:
+#if defined(__SSE__)
+  // MXCSR: FTZ is bit 15, DAZ bit 6
+  using Mode = uint32_t;
+  static constexpr Mode FLUSH_BITS = 0x8040;
+  static Mode read_mode() noexcept { return _mm_getcsr(); }
+  static void write_mode(Mode mode) noexcept { _mm_setcsr(mode); }
+#elif defined(__aarch64__)
+  // FPCR: FZ is bit 24 and covers both inputs and results
+  using Mode = uint64_t;
+  static constexpr Mode FLUSH_BITS = Mode{1} << 24;
+  static Mode read_mode() noexcept {
+    Mode mode;
+    asm volatile("mrs %0, fpcr" : "=r"(mode));
+    return mode;
+  }
+  static void write_mode(Mode mode) noexcept {
+    asm volatile("msr fpcr, %0" : : "r"(mode));
+  }
+#elif defined(__arm__) && defined(__ARM_FP)
+  // FPSCR: FZ is bit 24
+  using Mode = uint32_t;
+  static constexpr Mode FLUSH_BITS = Mode{1} << 24;
+  static Mode read_mode() noexcept {
+    Mode mode;
+    asm volatile("vmrs %0, fpscr" : "=r"(mode));
+    return mode;
+  }
+  static void write_mode(Mode mode) noexcept {
+    asm volatile("vmsr fpscr, %0" : : "r"(mode));
+  }
+#else
+  using Mode = uint32_t;
+  static constexpr Mode FLUSH_BITS = 0;
+  static Mode read_mode() noexcept { return 0; }
+  static void write_mode(Mode) noexcept {}
+#endif
+
+  Mode saved;
+};
+
+// Spin-wait hint for busy loops
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+} // namespace rt
@@ -0,0 +1,87 @@
+#pragma once
+
+// Debug mode: abort on any heap allocation or free made inside a process
+// callback, reported with write(2) since stdio may allocate. The
+// replacement operators are defined here, so include this header from
+// exactly one translation unit of each executable: the one with main.
+// Without DEARJACK_RT_ALLOC_CHECK it is empty.
+
+#include "rt.h"
+
+#ifdef DEARJACK_RT_ALLOC_CHECK
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+namespace rt {
+[[noreturn]] inline void allocation_violation() noexcept {
+  static const char message[] =
+      "DearJack: heap allocation inside the JACK process callback\n";
+  [[maybe_unused]] auto written = ::write(2, message, sizeof(message) - 1);
+  std::abort();
+}
+
+inline void *checked_alloc(std::size_t size, std::size_t alignment) noexcept {
+  if (in_process_callback) {
+    allocation_violation();
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  if (alignment <= alignof(std::max_align_t)) {
+    return std::malloc(size);
+  }
+  return std::aligned_alloc(alignment, (size + alignment - 1) / alignment *
+                                           alignment);
+}
+
+inline void checked_free(void *ptr) noexcept {
+  if (ptr && in_process_callback) {
+    allocation_violation();
+  }
+  std::free(ptr);
+}
+} // namespace rt
+
+void *operator new(std::size_t size) {
+  if (void *ptr = rt::checked_alloc(size, alignof(std::max_align_t))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  if (void *ptr = rt::checked_alloc(size, static_cast<std::size_t>(alignment))) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return rt::checked_alloc(size, alignof(std::max_align_t));
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return rt::checked_alloc(size, alignof(std::max_align_t));
+}
+void operator delete(void *ptr) noexcept { rt::checked_free(ptr); }
+void operator delete[](void *ptr) noexcept { rt::checked_free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { rt::checked_free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept {
+  rt::checked_free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  rt::checked_free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  rt::checked_free(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  rt::checked_free(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  rt::checked_free(ptr);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,686 @@
+#include "session.h"
+
+#include "dsp_factory.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+// File layout. Every field is a 32-bit little-endian word, so the mapped
+// file is read in place without parsing:
+//
+//   Header
+//   ClientRecord[num_clients]
+//   InstanceRecord[num_instances]     grouped by client, in client order
+//   ParameterRecord[num_parameters]   grouped by instance, in order
+//   ConnectionRecord[num_connections]
+//   String table                      null-terminated, deduplicated
+//
+// Strings are referenced by their byte offset in the table. Version 1 files,
+// written before instances had an oversampling factor, are still read.
+static_assert(std::endian::native == std::endian::little,
+              "Session files are read in place as little-endian");
+
+namespace {
+
+constexpr char MAGIC[4] = {'D', 'J', 'S', 'S'};
+constexpr uint32_t FORMAT_VERSION = 2;
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_clients;
+  uint32_t num_instances;
+  uint32_t num_parameters;
+  uint32_t num_connections;
+  uint32_t strings_size;
+  uint32_t reserved;
+};
+
+struct ClientRecord {
+  uint32_t name;
+  uint32_t first_instance;
+  uint32_t num_instances;
+};
+
+struct InstanceRecord {
+  uint32_t name;
+  uint32_t port_prefix;
+  uint32_t dsp_type;
+  int32_t voices;
+  int32_t oversampling;
+  uint32_t first_parameter;
+  uint32_t num_parameters;
+};
+
+// InstanceRecord of version 1 files, read as oversampling 1
+struct InstanceRecordV1 {
+  uint32_t name;
+  uint32_t port_prefix;
+  uint32_t dsp_type;
+  int32_t voices;
+  uint32_t first_parameter;
+  uint32_t num_parameters;
+};
+
+// value holds the float's bits, the int, or a string offset, by type
+struct ParameterRecord {
+  uint32_t name;
+  uint32_t type; // Index of the alternative in ParameterValue
+  uint32_t value;
+};
+
+struct ConnectionRecord {
+  uint32_t source;
+  uint32_t destination;
+};
+
+// Builds the string table, storing each distinct string once
+class StringTable {
+public:
+  uint32_t add(const std::string &value) {
+    auto [it, inserted] =
+        offsets.try_emplace(value, static_cast<uint32_t>(data.size()));
+    if (inserted) {
+      data.insert(data.end(), value.begin(), value.end());
+      data.push_back('\0');
+    }
+    return it->second;
+  }
+
+  // Padded to a whole number of words
+  const std::vector<char> &padded() {
+    data.resize((data.size() + 3) & ~size_t{3}, '\0');
+    return data;
+  }
+
+private:
+  std::unordered_map<std::string, uint32_t> offsets;
+  std::vector<char> data;
+};
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+      ::close(fd);
+      throw std::runtime_error("Cannot read " + path);
+    }
+    size = static_cast<size_t>(info.st_size);
+    data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("Cannot map " + path + ": " +
+                               std::strerror(errno));
+    }
+  }
+  ~MappedFile() { ::munmap(data, size); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *bytes() const { return static_cast<const uint8_t *>(data); }
+  size_t get_size() const { return size; }
+
+private:
+  void *data = nullptr;
+  size_t size = 0;
+};
+
+// Bounds-checked view of a mapped session
+class SessionReader {
+public:
+  SessionReader(const uint8_t *data, size_t size, const std::string &path)
+      : data(data), size(size), path(path) {
+    header = take<Header>(1);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+      fail("not a session file");
+    }
+    if (header->version != FORMAT_VERSION && header->version != 1) {
+      fail("unsupported version " + std::to_string(header->version));
+    }
+    clients = take<ClientRecord>(header->num_clients);
+    if (header->version == 1) {
+      const InstanceRecordV1 *old =
+          take<InstanceRecordV1>(header->num_instances);
+      upgraded_instances.reserve(header->num_instances);
+      for (uint32_t i = 0; i < header->num_instances; ++i) {
+        upgraded_instances.push_back({old[i].name, old[i].port_prefix,
+                                      old[i].dsp_type, old[i].voices, 1,
+                                      old[i].first_parameter,
+                                      old[i].num_parameters});
+      }
+      instances = upgraded_instances.data();
+    } else {
+      instances = take<InstanceRecord>(header->num_instances);
+    }
+    parameters = take<ParameterRecord>(header->num_parameters);
+    connections = take<ConnectionRecord>(header->num_connections);
+    strings = reinterpret_cast<const char *>(
+        take<uint8_t>(header->strings_size));
+    // Every string ends before the table does
+    if (header->strings_size > 0 && strings[header->strings_size - 1] != '\0') {
+      fail("unterminated string table");
+    }
+  }
+
+  Session read() {
+    Session session;
+    session.clients.reserve(header->num_clients);
+    for (uint32_t c = 0; c < header->num_clients; ++c) {
+      const ClientRecord &record = clients[c];
+      check_range(record.first_instance, record.num_instances,
+                  header->num_instances);
+      SessionClient &client = session.clients.emplace_back();
+      client.name = string(record.name);
+      client.instances.reserve(record.num_instances);
+      for (uint32_t i = 0; i < record.num_instances; ++i) {
+        client.instances.push_back(
+            read_instance(instances[record.first_instance + i]));
+      }
+    }
+    session.connections.reserve(header->num_connections);
+    for (uint32_t c = 0; c < header->num_connections; ++c) {
+      session.connections.push_back(
+          {string(connections[c].source), string(connections[c].destination)});
+    }
+    return session;
+  }
+
+private:
+  SessionInstance read_instance(const InstanceRecord &record) {
+    check_range(record.first_parameter, record.num_parameters,
+                header->num_parameters);
+    SessionInstance instance;
+    instance.name = string(record.name);
+    instance.port_prefix = string(record.port_prefix);
+    instance.source = {string(record.dsp_type), record.voices,
+                       record.oversampling};
+    instance.parameters.reserve(record.num_parameters);
+    for (uint32_t p = 0; p < record.num_parameters; ++p) {
+      const ParameterRecord &parameter =
+          parameters[record.first_parameter + p];
+      SessionParameter &saved = instance.parameters.emplace_back();
+      saved.name = string(parameter.name);
+      switch (parameter.type) {
+      case 0: {
+        float value;
+        std::memcpy(&value, &parameter.value, sizeof(value));
+        saved.value = value;
+        break;
+      }
+      case 1:
+        saved.value = static_cast<int>(parameter.value);
+        break;
+      case 2:
+        saved.value = string(parameter.value);
+        break;
+      default:
+        fail("bad parameter type");
+      }
+    }
+    return instance;
+  }
+
+  template <typename T> const T *take(uint32_t count) {
+    const size_t bytes = sizeof(T) * static_cast<size_t>(count);
+    if (bytes > size - offset) {
+      fail("truncated");
+    }
+    const T *records = reinterpret_cast<const T *>(data + offset);
+    offset += bytes;
+    return records;
+  }
+
+  std::string string(uint32_t offset) const {
+    if (offset >= header->strings_size) {
+      fail("bad string offset");
+    }
+    return std::string(strings + offset);
+  }
+
+  void check_range(uint32_t first, uint32_t count, uint32_t total) const {
+    if (first > total || count > total - first) {
+      fail("bad record range");
+    }
+  }
+
+  [[noreturn]] void fail(const std::string &reason) const {
+    throw std::runtime_error(path + ": " + reason);
+  }
+
+  const uint8_t *data;
+  size_t size;
+  size_t offset = 0;
+  const std::string &path;
+  const Header *header = nullptr;
+  const ClientRecord *clients = nullptr;
+  const InstanceRecord *instances = nullptr;
+  // Version 1 instances, converted
+  std::vector<InstanceRecord> upgraded_instances;
+  const ParameterRecord *parameters = nullptr;
+  const ConnectionRecord *connections = nullptr;
+  const char *strings = nullptr;
+};
+
+template <typename T>
+void write_records(std::FILE *file, const std::vector<T> &records) {
+  if (!records.empty()) {
+    std::fwrite(records.data(), sizeof(T), records.size(), file);
+  }
+}
+
+// Adds the connections of one port, output side first
+void capture_connections(jack_port_t *port, bool is_output,
+                         std::set<std::pair<std::string, std::string>> &out) {
+  const char **peers = jack_port_get_connections(port);
+  if (!peers) {
+    return;
+  }
+  const std::string own = jack_port_name(port);
+  for (const char **peer = peers; *peer; ++peer) {
+    if (is_output) {
+      out.emplace(own, *peer);
+    } else {
+      out.emplace(*peer, own);
+    }
+  }
+  jack_free(peers);
+}
+
+void append_json_string(const std::string &value, std::string &out) {
+  out += '"';
+  for (char c : value) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out += escaped;
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+} // namespace
+
+Session capture_session(const std::vector<const JackClient *> &clients) {
+  Session session;
+  std::set<std::pair<std::string, std::string>> connections;
+  for (const JackClient *client : clients) {
+    SessionClient &saved_client = session.clients.emplace_back();
+    saved_client.name = client->get_name();
+    for (const auto &instance : client->get_instances()) {
+      SessionInstance &saved = saved_client.instances.emplace_back();
+      saved.name = instance->name;
+      saved.port_prefix = instance->port_prefix;
+      saved.source = instance->source;
+      for (const auto &descriptor :
+           instance->get_dsp()->get_parameter_descriptors()) {
+        saved.parameters.push_back(
+            {descriptor.name, instance->parameters.get(descriptor.id)});
+      }
+
+      for (jack_port_t *port : instance->input_ports) {
+        capture_connections(port, false, connections);
+      }
+      for (jack_port_t *port : instance->output_ports) {
+        capture_connections(port, true, connections);
+      }
+      if (instance->midi_port) {
+        capture_connections(instance->midi_port, false, connections);
+      }
+    }
+  }
+  for (const auto &[source, destination] : connections) {
+    session.connections.push_back({source, destination});
+  }
+  return session;
+}
+
+void save_session(const Session &session, const std::string &path) {
+  StringTable strings;
+  std::vector<ClientRecord> clients;
+  std::vector<InstanceRecord> instances;
+  std::vector<ParameterRecord> parameters;
+  std::vector<ConnectionRecord> connections;
+
+  for (const SessionClient &client : session.clients) {
+    clients.push_back({strings.add(client.name),
+                       static_cast<uint32_t>(instances.size()),
+                       static_cast<uint32_t>(client.instances.size())});
+    for (const SessionInstance &instance : client.instances) {
+      instances.push_back({strings.add(instance.name),
+                           strings.add(instance.port_prefix),
+                           strings.add(instance.source.type),
+                           instance.source.voices,
+                           instance.source.oversampling,
+                           static_cast<uint32_t>(parameters.size()),
+                           static_cast<uint32_t>(instance.parameters.size())});
+      for (const SessionParameter &parameter : instance.parameters) {
+        ParameterRecord record{strings.add(parameter.name),
+                               static_cast<uint32_t>(parameter.value.index()),
+                               0};
+        if (const float *f = std::get_if<float>(&parameter.value)) {
+          std::memcpy(&record.value, f, sizeof(record.value));
+        } else if (const int *i = std::get_if<int>(&parameter.value)) {
+          record.value = static_cast<uint32_t>(*i);
+        } else {
+          record.value = strings.add(std::get<std::string>(parameter.value));
+        }
+        parameters.push_back(record);
+      }
+    }
+  }
+  for (const SessionConnection &connection : session.connections) {
+    connections.push_back(
+        {strings.add(connection.source), strings.add(connection.destination)});
+  }
+
+  const std::vector<char> &table = strings.padded();
+  Header header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.num_clients = static_cast<uint32_t>(clients.size());
+  header.num_instances = static_cast<uint32_t>(instances.size());
+  header.num_parameters = static_cast<uint32_t>(parameters.size());
+  header.num_connections = static_cast<uint32_t>(connections.size());
+  header.strings_size = static_cast<uint32_t>(table.size());
+
+  // Written next to the target and renamed over it, so a failed save never
+  // leaves a truncated session behind
+  const std::string temporary = path + ".tmp";
+  std::FILE *file = std::fopen(temporary.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error("Cannot write " + temporary + ": " +
+                             std::strerror(errno));
+  }
+  std::fwrite(&header, sizeof(header), 1, file);
+  write_records(file, clients);
+  write_records(file, instances);
+  write_records(file, parameters);
+  write_records(file, connections);
+  std::fwrite(table.data(), 1, table.size(), file);
+  const bool ok = !std::ferror(file);
+  if (std::fclose(file) != 0 || !ok ||
+      std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Failed to write " + path);
+  }
+}
+
+Session load_session(const std::string &path) {
+  MappedFile file(path);
+  return SessionReader(file.bytes(), file.get_size(), path).read();
+}
+
+std::string session_to_json(const Session &session) {
+  std::string out = "{\n  \"clients\": [";
+  for (size_t c = 0; c < session.clients.size(); ++c) {
+    const SessionClient &client = session.clients[c];
+    out += c ? ",\n    {\"name\": " : "\n    {\"name\": ";
+    append_json_string(client.name, out);
+    out += ", \"instances\": [";
+    for (size_t i = 0; i < client.instances.size(); ++i) {
+      const SessionInstance &instance = client.instances[i];
+      out += i ? ",\n      {\"name\": " : "\n      {\"name\": ";
+      append_json_string(instance.name, out);
+      out += ", \"port_prefix\": ";
+      append_json_string(instance.port_prefix, out);
+      out += ", \"type\": ";
+      append_json_string(instance.source.type, out);
+      out += ", \"voices\": " + std::to_string(instance.source.voices);
+      out += ", \"oversampling\": " +
+             std::to_string(instance.source.oversampling);
+      out += ", \"parameters\": {";
+      for (size_t p = 0; p < instance.parameters.size(); ++p) {
+        const SessionParameter &parameter = instance.parameters[p];
+        out += p ? ", " : "";
+        append_json_string(parameter.name, out);
+        out += ": ";
+        if (const float *f = std::get_if<float>(&parameter.value)) {
+          char number[32];
+          // Enough digits to round-trip a float
+          std::snprintf(number, sizeof(number), "%.9g", *f);
+          out += number;
+        } else if (const int *v = std::get_if<int>(&parameter.value)) {
+          out += std::to_string(*v);
+        } else {
+          append_json_string(std::get<std::string>(parameter.value), out);
+        }
+      }
+      out += "}}";
+    }
+    out += client.instances.empty() ? "]}" : "\n    ]}";
+  }
+  out += session.clients.empty() ? "],\n" : "\n  ],\n";
+  out += "  \"connections\": [";
+  for (size_t c = 0; c < session.connections.size(); ++c) {
+    out += c ? ",\n    [" : "\n    [";
+    append_json_string(session.connections[c].source, out);
+    out += ", ";
+    append_json_string(session.connections[c].destination, out);
+    out += "]";
+  }
+  out += session.connections.empty() ? "]\n}\n" : "\n  ]\n}\n";
+  return out;
+}
+
+void restore_instances(const SessionClient &saved, JackClient &client) {
+  for (const SessionInstance &instance : saved.instances) {
+    std::unique_ptr<DSP> dsp;
+    try {
+      dsp = create_instance_dsp(instance.source.type,
+                                std::max(1, instance.source.voices),
+                                instance.source.oversampling);
+    } catch (const std::exception &e) {
+      std::cerr << "Skipping instance " << instance.name << ": " << e.what()
+                << std::endl;
+      continue;
+    }
+    client.add_instance(instance.name, std::move(dsp), instance.port_prefix,
+                        instance.source);
+    JackClient::Instance &added = *client.find_instance(instance.name);
+    const DSP &added_dsp = *added.get_dsp();
+    for (const SessionParameter &parameter : instance.parameters) {
+      // Parameters are matched by name and type, so sessions survive DSPs
+      // gaining or reordering parameters
+      const ParameterId id = added_dsp.find_parameter(parameter.name);
+      if (id != INVALID_PARAMETER &&
+          added.parameters.get(id).index() == parameter.value.index()) {
+        client.set_parameter(added, id, parameter.value);
+      }
+    }
+  }
+  client.commit_parameters();
+}
+
+namespace {
+
+using ClientNames = std::unordered_map<std::string, std::string>;
+
+// "client:port" with the client part mapped through renamed
+std::string renamed_port(const std::string &port, const ClientNames &renamed) {
+  const size_t colon = port.find(':');
+  const auto it = renamed.find(port.substr(0, colon));
+  return it == renamed.end() || colon == std::string::npos
+             ? port
+             : it->second + port.substr(colon);
+}
+
+void restore_connection(const SessionConnection &connection,
+                        JackClient &client, const ClientNames &renamed) {
+  const std::string source = renamed_port(connection.source, renamed);
+  const std::string destination =
+      renamed_port(connection.destination, renamed);
+  if (!client.connect(source, destination)) {
+    std::cerr << "Cannot connect " << source << " to " << destination
+              << std::endl;
+  }
+}
+
+} // namespace
+
+void restore_connections(const Session &session, JackClient &client) {
+  for (const SessionConnection &connection : session.connections) {
+    restore_connection(connection, client, {});
+  }
+}
+
+std::vector<std::unique_ptr<JackClient>>
+restore_session(const Session &session) {
+  SessionRestore restore(session);
+  restore.start();
+  restore.wait();
+  return restore.take_clients();
+}
+
+// Shared with the tasks, which may outlive the SessionRestore
+struct SessionRestore::State {
+  Session session;
+  std::function<void()> on_progress;
+  // Slot per saved client, filled by its task; null if it failed to open
+  std::vector<std::unique_ptr<JackClient>> clients;
+  // Set up once every client task has finished, read-only afterwards
+  std::vector<JackClient *> opened;
+  ClientNames renamed;
+  std::atomic<size_t> clients_left{0};
+  std::atomic<size_t> completed{0};
+  size_t total = 0;
+
+  void step_done() {
+    completed.fetch_add(1, std::memory_order_acq_rel);
+    completed.notify_all();
+    if (on_progress) {
+      on_progress();
+    }
+  }
+
+  static void open_client(const std::shared_ptr<State> &state, size_t index) {
+    const SessionClient &saved = state->session.clients[index];
+    try {
+      auto client = std::make_unique<JackClient>(saved.name.c_str());
+      restore_instances(saved, *client);
+      state->clients[index] = std::move(client);
+    } catch (const std::exception &e) {
+      std::cerr << "Cannot restore client " << saved.name << ": " << e.what()
+                << std::endl;
+    }
+    // The last client in starts the connections, as every port exists now
+    const bool last =
+        state->clients_left.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    state->step_done();
+    if (last) {
+      connect_all(state);
+    }
+  }
+
+  static void connect_all(const std::shared_ptr<State> &state) {
+    for (size_t c = 0; c < state->clients.size(); ++c) {
+      if (JackClient *client = state->clients[c].get()) {
+        state->opened.push_back(client);
+        const std::string &saved_name = state->session.clients[c].name;
+        if (saved_name != client->get_name()) {
+          state->renamed.emplace(saved_name, client->get_name());
+        }
+      }
+    }
+    // A saved name some client still got exactly is not a rename
+    for (JackClient *client : state->opened) {
+      state->renamed.erase(client->get_name());
+    }
+    const size_t count = state->session.connections.size();
+    for (size_t c = 0; c < count; ++c) {
+      if (state->opened.empty()) {
+        state->step_done();
+        continue;
+      }
+      // Any client can connect any two ports; spreading the requests over
+      // the clients lets them go through their own server channels
+      ThreadManager::run_blocking_task([state, c] {
+        restore_connection(state->session.connections[c],
+                           *state->opened[c % state->opened.size()],
+                           state->renamed);
+        state->step_done();
+      });
+    }
+  }
+};
+
+SessionRestore::SessionRestore(Session session,
+                               std::function<void()> on_progress)
+    : state(std::make_shared<State>()) {
+  state->session = std::move(session);
+  state->on_progress = std::move(on_progress);
+  state->clients.resize(state->session.clients.size());
+  state->clients_left.store(state->session.clients.size());
+  state->total =
+      state->session.clients.size() + state->session.connections.size();
+}
+
+void SessionRestore::start() {
+  if (state->session.clients.empty()) {
+    State::connect_all(state);
+  }
+  for (size_t c = 0; c < state->session.clients.size(); ++c) {
+    ThreadManager::run_blocking_task(
+        [state = state, c] { State::open_client(state, c); });
+  }
+}
+
+size_t SessionRestore::get_completed_steps() const {
+  return state->completed.load(std::memory_order_acquire);
+}
+
+size_t SessionRestore::get_total_steps() const { return state->total; }
+
+void SessionRestore::wait() const {
+  for (size_t done = get_completed_steps(); done != state->total;
+       done = get_completed_steps()) {
+    state->completed.wait(done, std::memory_order_acquire);
+  }
+}
+
+std::vector<std::unique_ptr<JackClient>> SessionRestore::take_clients() {
+  std::vector<std::unique_ptr<JackClient>> clients;
+  for (auto &client : state->clients) {
+    if (client) {
+      clients.push_back(std::move(client));
+    }
+  }
+  return clients;
+}
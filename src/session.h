@@ -0,0 +1,101 @@
+#pragma once
+
+#include "dsp.h"
+#include "jack_client.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A saved rig: every client with its instances and their parameter values,
+// plus the port connections between them and the rest of the JACK graph.
+//
+// Sessions are stored in a compact binary file that is memory-mapped to
+// load; see session.cpp for the layout. session_to_json() renders the same
+// content as text for diffing and review; it is not read back.
+struct SessionParameter {
+  std::string name;
+  ParameterValue value;
+};
+
+struct SessionInstance {
+  std::string name;
+  std::string port_prefix;
+  DSPSource source;
+  std::vector<SessionParameter> parameters;
+};
+
+struct SessionClient {
+  std::string name;
+  std::vector<SessionInstance> instances;
+};
+
+// Full port names, output first
+struct SessionConnection {
+  std::string source;
+  std::string destination;
+};
+
+struct Session {
+  std::vector<SessionClient> clients;
+  std::vector<SessionConnection> connections;
+};
+
+// Control thread only. Records the clients' instances, control-side
+// parameter values and the connections of their ports.
+Session capture_session(const std::vector<const JackClient *> &clients);
+
+// Throw std::runtime_error on I/O errors or, when loading, a file that is
+// not a valid session
+void save_session(const Session &session, const std::string &path);
+Session load_session(const std::string &path);
+
+std::string session_to_json(const Session &session);
+
+// Adds the instances of a saved client to client and applies their
+// parameter values in one commit. Instances of unknown DSP types are skipped
+// with a warning.
+void restore_instances(const SessionClient &saved, JackClient &client);
+// Makes the saved connections through client's JACK handle, which can
+// connect any two ports. Connections the graph cannot make (e.g. to a device
+// that is gone) are reported and skipped.
+void restore_connections(const Session &session, JackClient &client);
+// Opens every client of the session with its instances, then connects them;
+// a SessionRestore run to completion on the calling thread's behalf
+std::vector<std::unique_ptr<JackClient>>
+restore_session(const Session &session);
+
+// Restores a session on the ThreadManager pool. Every client is opened,
+// given its instances and activated on a worker at once, so the server
+// round trips of a large session overlap instead of adding up; once all
+// are up, the connections are made in parallel too. Connections to a client
+// the server renamed follow it to its new name.
+//
+// The control thread starts it, polls the progress and takes the clients
+// once it is done. An abandoned restore finishes in the background and
+// closes its clients.
+class SessionRestore {
+public:
+  // on_progress runs on a worker after every step, e.g. to wake the GUI
+  explicit SessionRestore(Session session,
+                          std::function<void()> on_progress = {});
+
+  // Queues the work; call once, from any thread
+  void start();
+
+  // One step per client and one per connection
+  size_t get_completed_steps() const;
+  size_t get_total_steps() const;
+  bool is_done() const { return get_completed_steps() == get_total_steps(); }
+  // Blocks until done
+  void wait() const;
+
+  // Once done: the clients that opened, in session order
+  std::vector<std::unique_ptr<JackClient>> take_clients();
+
+private:
+  struct State;
+  std::shared_ptr<State> state;
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Minimal SIMD abstraction for the DSP inner loops.
+//
+// simd::vfloat is a vector of vfloat::width floats backed by AVX2, SSE2 or
+// NEON depending on the compiler target, and by a plain array otherwise. The same
+// math functions are overloaded for float, so kernels written as generic
+// lambdas (`[](auto x) { ... }`) also handle block tails one sample at a time.
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define DEARJACK_SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DEARJACK_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DEARJACK_SIMD_NEON 1
+#endif
+
+namespace simd {
+
+// Scalar overloads
+inline float floor(float x) { return std::floor(x); }
+inline float select(bool mask, float a, float b) { return mask ? a : b; }
+inline float mul_add(float a, float b, float c) { return a * b + c; }
+// base[index], with index a non-negative integral value held in a float
+inline float gather(const float *base, float index) {
+  return base[static_cast<int>(index)];
+}
+
+#if defined(DEARJACK_SIMD_AVX2)
+
+struct vmask {
+  __m256 v;
+};
+
+struct vfloat {
+  static constexpr size_t width = 8;
+
+  __m256 v;
+
+  vfloat() = default;
+  explicit vfloat(__m256 x) : v(x) {}
+  vfloat(float x) : v(_mm256_set1_ps(x)) {}
+
+  static vfloat load(const float *p) { return vfloat(_mm256_loadu_ps(p)); }
+  void store(float *p) const { _mm256_storeu_ps(p, v); }
+  // {0, 1, 2, ...}
+  static vfloat ramp() {
+    return vfloat(_mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f,
+                                 7.0f));
+  }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) {
+  return vfloat(_mm256_add_ps(a.v, b.v));
+}
+inline vfloat operator-(vfloat a, vfloat b) {
+  return vfloat(_mm256_sub_ps(a.v, b.v));
+}
+inline vfloat operator*(vfloat a, vfloat b) {
+  return vfloat(_mm256_mul_ps(a.v, b.v));
+}
+inline vmask operator<(vfloat a, vfloat b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)};
+}
+inline vmask operator>(vfloat a, vfloat b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)};
+}
+inline vmask operator>=(vfloat a, vfloat b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)};
+}
+inline vmask operator&(vmask a, vmask b) { return {_mm256_and_ps(a.v, b.v)}; }
+
+inline vfloat floor(vfloat x) { return vfloat(_mm256_floor_ps(x.v)); }
+inline vfloat select(vmask mask, vfloat a, vfloat b) {
+  return vfloat(_mm256_blendv_ps(b.v, a.v, mask.v));
+}
+inline vfloat mul_add(vfloat a, vfloat b, vfloat c) {
+  return vfloat(_mm256_fmadd_ps(a.v, b.v, c.v));
+}
+inline vfloat gather(const float *base, vfloat index) {
+  return vfloat(_mm256_i32gather_ps(base, _mm256_cvttps_epi32(index.v), 4));
+}
+
+#elif defined(DEARJACK_SIMD_SSE2)
+
+struct vmask {
+  __m128 v;
+};
+
+struct vfloat {
+  static constexpr size_t width = 4;
+
+  __m128 v;
+
+  vfloat() = default;
+  explicit vfloat(__m128 x) : v(x) {}
+  vfloat(float x) : v(_mm_set1_ps(x)) {}
+
+  static vfloat load(const float *p) { return vfloat(_mm_loadu_ps(p)); }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+  // {0, 1, 2, ...}
+  static vfloat ramp() { return vfloat(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return vfloat(_mm_add_ps(a.v, b.v)); }
+inline vfloat operator-(vfloat a, vfloat b) { return vfloat(_mm_sub_ps(a.v, b.v)); }
+inline vfloat operator*(vfloat a, vfloat b) { return vfloat(_mm_mul_ps(a.v, b.v)); }
+inline vmask operator<(vfloat a, vfloat b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline vmask operator>(vfloat a, vfloat b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline vmask operator&(vmask a, vmask b) { return {_mm_and_ps(a.v, b.v)}; }
+
+// SSE2 has no rounding instruction: truncate, then step down where that
+// rounded up. Valid for |x| < 2^31, which covers phases and table indices.
+inline vfloat floor(vfloat x) {
+  const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x.v));
+  const __m128 too_high = _mm_cmpgt_ps(truncated, x.v);
+  return vfloat(_mm_sub_ps(truncated, _mm_and_ps(too_high, _mm_set1_ps(1.0f))));
+}
+inline vfloat select(vmask mask, vfloat a, vfloat b) {
+  return vfloat(
+      _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+}
+inline vfloat mul_add(vfloat a, vfloat b, vfloat c) { return a * b + c; }
+
+// Lane-by-lane lookup for targets without a gather instruction
+inline vfloat gather(const float *base, vfloat index) {
+  alignas(16) float indices[vfloat::width];
+  alignas(16) float values[vfloat::width];
+  index.store(indices);
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    values[i] = base[static_cast<int>(indices[i])];
+  }
+  return vfloat::load(values);
+}
+
+#elif defined(DEARJACK_SIMD_NEON)
+
+struct vmask {
+  uint32x4_t v;
+};
+
+struct vfloat {
+  static constexpr size_t width = 4;
+
+  float32x4_t v;
+
+  vfloat() = default;
+  explicit vfloat(float32x4_t x) : v(x) {}
+  vfloat(float x) : v(vdupq_n_f32(x)) {}
+
+  static vfloat load(const float *p) { return vfloat(vld1q_f32(p)); }
+  void store(float *p) const { vst1q_f32(p, v); }
+  // {0, 1, 2, ...}
+  static vfloat ramp() {
+    static const float values[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    return load(values);
+  }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return vfloat(vaddq_f32(a.v, b.v)); }
+inline vfloat operator-(vfloat a, vfloat b) { return vfloat(vsubq_f32(a.v, b.v)); }
+inline vfloat operator*(vfloat a, vfloat b) { return vfloat(vmulq_f32(a.v, b.v)); }
+inline vmask operator<(vfloat a, vfloat b) { return {vcltq_f32(a.v, b.v)}; }
+inline vmask operator>(vfloat a, vfloat b) { return {vcgtq_f32(a.v, b.v)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {vcgeq_f32(a.v, b.v)}; }
+inline vmask operator&(vmask a, vmask b) { return {vandq_u32(a.v, b.v)}; }
+
+inline vfloat floor(vfloat x) { return vfloat(vrndmq_f32(x.v)); }
+inline vfloat select(vmask mask, vfloat a, vfloat b) {
+  return vfloat(vbslq_f32(mask.v, a.v, b.v));
+}
+inline vfloat mul_add(vfloat a, vfloat b, vfloat c) {
+  return vfloat(vfmaq_f32(c.v, a.v, b.v));
+}
+
+// Lane-by-lane lookup for targets without a gather instruction
+inline vfloat gather(const float *base, vfloat index) {
+  alignas(16) float indices[vfloat::width];
+  alignas(16) float values[vfloat::width];
+  index.store(indices);
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    values[i] = base[static_cast<int>(indices[i])];
+  }
+  return vfloat::load(values);
+}
+
+#else
+
+// Portable fallback: fixed-size loops the compiler can auto-vectorize
+struct vmask {
+  static constexpr size_t width = 4;
+  bool v[width];
+};
+
+struct vfloat {
+  static constexpr size_t width = 4;
+
+  float v[width];
+
+  vfloat() = default;
+  vfloat(float x) {
+    for (size_t i = 0; i < width; ++i) {
+      v[i] = x;
+    }
+  }
+
+  static vfloat load(const float *p) {
+    vfloat r;
+    for (size_t i = 0; i < width; ++i) {
+      r.v[i] = p[i];
+    }
+    return r;
+  }
+  void store(float *p) const {
+    for (size_t i = 0; i < width; ++i) {
+      p[i] = v[i];
+    }
+  }
+  // {0, 1, 2, ...}
+  static vfloat ramp() {
+    vfloat r;
+    for (size_t i = 0; i < width; ++i) {
+      r.v[i] = static_cast<float>(i);
+    }
+    return r;
+  }
+};
+
+template <typename Op> inline vfloat map(vfloat a, vfloat b, Op op) {
+  vfloat r;
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    r.v[i] = op(a.v[i], b.v[i]);
+  }
+  return r;
+}
+
+template <typename Op> inline vmask compare(vfloat a, vfloat b, Op op) {
+  vmask r;
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    r.v[i] = op(a.v[i], b.v[i]);
+  }
+  return r;
+}
+
+inline vfloat operator+(vfloat a, vfloat b) {
+  return map(a, b, [](float x, float y) { return x + y; });
+}
+inline vfloat operator-(vfloat a, vfloat b) {
+  return map(a, b, [](float x, float y) { return x - y; });
+}
+inline vfloat operator*(vfloat a, vfloat b) {
+  return map(a, b, [](float x, float y) { return x * y; });
+}
+inline vmask operator<(vfloat a, vfloat b) {
+  return compare(a, b, [](float x, float y) { return x < y; });
+}
+inline vmask operator>(vfloat a, vfloat b) {
+  return compare(a, b, [](float x, float y) { return x > y; });
+}
+inline vmask operator>=(vfloat a, vfloat b) {
+  return compare(a, b, [](float x, float y) { return x >= y; });
+}
+inline vmask operator&(vmask a, vmask b) {
+  vmask r;
+  for (size_t i = 0; i < vmask::width; ++i) {
+    r.v[i] = a.v[i] && b.v[i];
+  }
+  return r;
+}
+
+inline vfloat floor(vfloat x) {
+  vfloat r;
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    r.v[i] = std::floor(x.v[i]);
+  }
+  return r;
+}
+inline vfloat select(vmask mask, vfloat a, vfloat b) {
+  vfloat r;
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    r.v[i] = mask.v[i] ? a.v[i] : b.v[i];
+  }
+  return r;
+}
+inline vfloat mul_add(vfloat a, vfloat b, vfloat c) { return a * b + c; }
+
+// Lane-by-lane lookup for targets without a gather instruction
+inline vfloat gather(const float *base, vfloat index) {
+  alignas(16) float indices[vfloat::width];
+  alignas(16) float values[vfloat::width];
+  index.store(indices);
+  for (size_t i = 0; i < vfloat::width; ++i) {
+    values[i] = base[static_cast<int>(indices[i])];
+  }
+  return vfloat::load(values);
+}
+
+#endif
+
+// Fast waveform kernels. Phases are in cycles and may lie outside [0, 1).
+
+// sin(2 * pi * phase), max error about 1e-7 over the full cycle
+template <typename V> inline V sin_cycles(V phase) {
+  // Reduce to [-0.5, 0.5), then fold onto [-0.25, 0.25] using
+  // sin(pi - x) = sin(x)
+  V x = phase - floor(phase + V(0.5f));
+  x = select(x > V(0.25f), V(0.5f) - x, x);
+  x = select(x < V(-0.25f), V(-0.5f) - x, x);
+
+  // Odd Taylor polynomial of degree 11 in t = 2 * pi * x, |t| <= pi / 2
+  const V t = x * V(6.28318530717958647692f);
+  const V t2 = t * t;
+  V p = V(-2.50521083854417187751e-8f);
+  p = mul_add(p, t2, V(2.75573192239858906526e-6f));
+  p = mul_add(p, t2, V(-1.98412698412698412698e-4f));
+  p = mul_add(p, t2, V(8.33333333333333333333e-3f));
+  p = mul_add(p, t2, V(-1.66666666666666666667e-1f));
+  p = mul_add(p, t2, V(1.0f));
+  return p * t;
+}
+
+// +1 on the first half of the cycle, -1 on the second
+template <typename V> inline V square_cycles(V phase) {
+  const V x = phase - floor(phase);
+  return select((x > V(0.0f)) & (x < V(0.5f)), V(1.0f), V(-1.0f));
+}
+
+// Rises from -1 to 1 over the cycle, centred on phase 0
+template <typename V> inline V saw_cycles(V phase) {
+  return V(2.0f) * (phase - floor(phase + V(0.5f)));
+}
+
+// Block helpers
+
+// Level of a block for meters: the largest |src[i]| and the sum of squares
+struct BlockLevel {
+  float peak = 0.0f;
+  float energy = 0.0f;
+};
+
+inline BlockLevel block_level(const float *src, size_t n) {
+  vfloat peak(0.0f);
+  vfloat energy(0.0f);
+  size_t i = 0;
+  for (; i + vfloat::width <= n; i += vfloat::width) {
+    const vfloat x = vfloat::load(src + i);
+    const vfloat magnitude = select(x < vfloat(0.0f), vfloat(0.0f) - x, x);
+    peak = select(magnitude > peak, magnitude, peak);
+    energy = mul_add(x, x, energy);
+  }
+  float peak_lanes[vfloat::width];
+  float energy_lanes[vfloat::width];
+  peak.store(peak_lanes);
+  energy.store(energy_lanes);
+  BlockLevel level;
+  for (size_t lane = 0; lane < vfloat::width; ++lane) {
+    level.peak = std::max(level.peak, peak_lanes[lane]);
+    level.energy += energy_lanes[lane];
+  }
+  for (; i < n; ++i) {
+    level.peak = std::max(level.peak, std::fabs(src[i]));
+    level.energy += src[i] * src[i];
+  }
+  return level;
+}
+
+// dst[i] += src[i]
+inline void add_to(float *dst, const float *src, size_t n) {
+  size_t i = 0;
+  for (; i + vfloat::width <= n; i += vfloat::width) {
+    (vfloat::load(dst + i) + vfloat::load(src + i)).store(dst + i);
+  }
+  for (; i < n; ++i) {
+    dst[i] += src[i];
+  }
+}
+
+} // namespace simd
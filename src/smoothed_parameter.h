@@ -0,0 +1,83 @@
+#pragma once
+
+#include "dsp.h"
+#include <algorithm>
+#include <cmath>
+
+// Parameter value across one block: start + i * step at sample i
+struct ParameterRamp {
+  float start = 0.0f;
+  float step = 0.0f;
+
+  float at(jack_nframes_t i) const { return start + step * i; }
+  bool is_constant() const { return step == 0.0f; }
+};
+
+// Audio-thread follower of one parameter's target, configured by its
+// descriptor.
+//
+// next_block() moves the value toward the target by one block's worth of
+// the descriptor's curve and returns the motion as a linear ramp, which the
+// DSP applies per sample in its inner loop. Exponential curves are thus
+// sampled at block boundaries and interpolated linearly in between. Once
+// the target is reached the ramp is constant and costs nothing extra.
+class SmoothedParameter {
+public:
+  explicit SmoothedParameter(const ParameterDescriptor &descriptor)
+      : smoothing(descriptor.smoothing), time(descriptor.smoothing_time),
+        // Closer than this counts as settled
+        tolerance(1e-6f * (descriptor.max_value - descriptor.min_value)),
+        current(descriptor.default_value), linear_from(current),
+        linear_to(current) {}
+
+  ParameterRamp next_block(float target, jack_nframes_t nframes,
+                           double sample_rate) {
+    const float start = current;
+    if (snap || smoothing == Smoothing::None || time <= 0.0f) {
+      snap = false;
+      current = linear_from = linear_to = target;
+      return {target, 0.0f};
+    }
+    if (nframes == 0 || start == target) {
+      return {start, 0.0f};
+    }
+
+    const double samples = time * sample_rate;
+    if (smoothing == Smoothing::Linear) {
+      // A new target restarts the ramp from where the value is now
+      if (target != linear_to) {
+        linear_from = start;
+        linear_to = target;
+      }
+      const float advance = static_cast<float>(
+          std::abs(linear_to - linear_from) * (nframes / samples));
+      current = target > start ? std::min(target, start + advance)
+                               : std::max(target, start - advance);
+    } else {
+      const double decay = std::exp(-(nframes / samples));
+      current = target + (start - target) * static_cast<float>(decay);
+      if (std::abs(current - target) <= tolerance) {
+        current = target;
+      }
+    }
+    return {start, (current - start) / static_cast<float>(nframes)};
+  }
+
+  // Jump to the target at the next block
+  void reset() { snap = true; }
+
+  // Value at the end of the last block
+  float get_current() const { return current; }
+
+private:
+  Smoothing smoothing;
+  float time;
+  float tolerance;
+  float current;
+  // Endpoints of the linear ramp in progress
+  float linear_from;
+  float linear_to;
+  // The first block starts at the target rather than ramping from the
+  // default value
+  bool snap = true;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Wait-free single-producer/single-consumer ring buffer.
+//
+// Slots are preallocated and reused, and the consumer reads them in place, so
+// values that own memory (strings) are only ever assigned and released by the
+// producer thread. This keeps the consumer side free of heap traffic.
+template <typename T, size_t Capacity> class SPSCQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "SPSCQueue capacity must be a power of two");
+
+public:
+  // Producer side. Returns false when the queue is full.
+  template <typename U> bool try_push(U &&value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == Capacity) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == Capacity) {
+        return false;
+      }
+    }
+    slots_[tail & (Capacity - 1)] = std::forward<U>(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Calls fn(const T &) for every queued element in order and
+  // returns how many were consumed.
+  template <typename Fn> size_t consume_all(Fn &&fn) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    for (size_t i = head; i != tail; ++i) {
+      fn(static_cast<const T &>(slots_[i & (Capacity - 1)]));
+    }
+    head_.store(tail, std::memory_order_release);
+    return tail - head;
+  }
+
+  // Consumer side. Copies out the oldest element; only suitable for types
+  // whose copy does not allocate.
+  bool try_pop(T &out) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    out = slots_[head & (Capacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+private:
+  static constexpr size_t cache_line = 64;
+
+  alignas(cache_line) std::atomic<size_t> head_{0};
+  alignas(cache_line) std::atomic<size_t> tail_{0};
+  // Producer's last observed head, avoids touching the consumer's cache line
+  alignas(cache_line) size_t cached_head_ = 0;
+  alignas(cache_line) std::array<T, Capacity> slots_{};
+};
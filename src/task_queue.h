@@ -0,0 +1,229 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Type-erased callable with inline storage. Tasks never allocate and are
+// trivially copyable, so the lock-free queues below can move them around as
+// plain words.
+class Task {
+public:
+  static constexpr size_t CAPACITY = 48;
+
+  template <typename F>
+  static constexpr bool fits_inline =
+      sizeof(F) <= CAPACITY && alignof(F) <= alignof(std::max_align_t) &&
+      std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>;
+
+  Task() = default;
+
+  template <typename F,
+            typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+  Task(F &&fn) {
+    using Fn = std::decay_t<F>;
+    static_assert(fits_inline<Fn>,
+                  "Task callables must be small and trivially copyable; use "
+                  "Task::boxed for anything else");
+    new (storage) Fn(std::forward<F>(fn));
+    invoke = [](void *storage) { (*static_cast<Fn *>(storage))(); };
+  }
+
+  // Heap-allocates a wrapper for callables that do not fit inline. Not
+  // real-time safe; the wrapper is freed after the task runs.
+  template <typename F> static Task boxed(F &&fn) {
+    using Fn = std::decay_t<F>;
+    Fn *heap_fn = new Fn(std::forward<F>(fn));
+    return Task([heap_fn] {
+      (*heap_fn)();
+      delete heap_fn;
+    });
+  }
+
+  void operator()() { invoke(storage); }
+  explicit operator bool() const { return invoke != nullptr; }
+
+private:
+  void (*invoke)(void *) = nullptr;
+  alignas(std::max_align_t) unsigned char storage[CAPACITY];
+};
+
+static_assert(std::is_trivially_copyable_v<Task>);
+
+namespace detail {
+// Slot holding a trivially copyable T as relaxed atomic words, so a racing
+// reader sees a possibly torn but well-defined value that it then discards
+template <typename T> class AtomicSlot {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static constexpr size_t WORDS = (sizeof(T) + 7) / 8;
+
+public:
+  void store(const T &value) {
+    uint64_t buffer[WORDS] = {};
+    std::memcpy(buffer, &value, sizeof(T));
+    for (size_t i = 0; i < WORDS; ++i) {
+      words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+  }
+
+  T load() const {
+    uint64_t buffer[WORDS];
+    for (size_t i = 0; i < WORDS; ++i) {
+      buffer[i] = words[i].load(std::memory_order_relaxed);
+    }
+    T value;
+    std::memcpy(&value, buffer, sizeof(T));
+    return value;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, WORDS> words{};
+};
+} // namespace detail
+
+// Bounded Chase-Lev work-stealing deque. The owning worker pushes and pops
+// at the bottom; any other thread may steal from the top.
+template <typename T, size_t Capacity> class WorkStealingDeque {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "WorkStealingDeque capacity must be a power of two");
+
+public:
+  // Owner only. Returns false when full.
+  bool push(const T &value) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(Capacity)) {
+      return false;
+    }
+    slots[b & MASK].store(value);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Owner only. Takes the most recently pushed element.
+  bool pop(T &out) {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    out = slots[b & MASK].load();
+    if (t == b) {
+      // Last element: race thieves for it
+      const bool won = top.compare_exchange_strong(
+          t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread. Takes the oldest element; false if empty or lost a race.
+  bool steal(T &out) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    const T value = slots[t & MASK].load();
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return false;
+    }
+    out = value;
+    return true;
+  }
+
+  bool empty() const {
+    return top.load(std::memory_order_acquire) >=
+           bottom.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr int64_t MASK = static_cast<int64_t>(Capacity) - 1;
+  static constexpr size_t cache_line = 64;
+
+  alignas(cache_line) std::atomic<int64_t> top{0};
+  alignas(cache_line) std::atomic<int64_t> bottom{0};
+  alignas(cache_line) std::array<detail::AtomicSlot<T>, Capacity> slots{};
+};
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov). Used for
+// submissions from threads that do not own a work-stealing deque.
+template <typename T, size_t Capacity> class MPMCQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "MPMCQueue capacity must be a power of two");
+
+public:
+  MPMCQueue() {
+    for (size_t i = 0; i < Capacity; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool try_push(const T &value) {
+    size_t position = enqueue_position.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = cells[position & (Capacity - 1)];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t difference =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0) {
+        if (enqueue_position.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (difference < 0) {
+        return false; // Full
+      } else {
+        position = enqueue_position.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T &out) {
+    size_t position = dequeue_position.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = cells[position & (Capacity - 1)];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t difference = static_cast<intptr_t>(sequence) -
+                                  static_cast<intptr_t>(position + 1);
+      if (difference == 0) {
+        if (dequeue_position.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          out = cell.value;
+          cell.sequence.store(position + Capacity, std::memory_order_release);
+          return true;
+        }
+      } else if (difference < 0) {
+        return false; // Empty
+      } else {
+        position = dequeue_position.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  static constexpr size_t cache_line = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  alignas(cache_line) std::array<Cell, Capacity> cells;
+  alignas(cache_line) std::atomic<size_t> enqueue_position{0};
+  alignas(cache_line) std::atomic<size_t> dequeue_position{0};
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Wait-free latest-value channel from the audio thread to the GUI.
+//
+// A triple buffer: the producer fills its back slot and swaps it with the
+// shared middle one, and the consumer swaps the middle slot into its front
+// one when it holds a newer value. Neither side ever waits, the producer
+// overwrites values the consumer has not picked up yet, and the consumer
+// learns from update() whether anything arrived since its last look.
+// T is copied by assignment on the producer thread only, so it should be
+// trivially copyable.
+template <typename T> class TelemetryBuffer {
+public:
+  // Producer side. The slot to fill before publish().
+  T &back() { return slots[back_index]; }
+
+  // Producer side. Makes the back slot the newest value.
+  void publish() {
+    back_index =
+        middle.exchange(back_index | FRESH, std::memory_order_acq_rel) &
+        INDEX_MASK;
+  }
+
+  // Consumer side. Picks up the newest value and returns true if one was
+  // published since the last call.
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+    front_index =
+        middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+
+  // Consumer side, as of the last update()
+  const T &get() const { return slots[front_index]; }
+
+private:
+  static constexpr uint32_t INDEX_MASK = 0x3;
+  static constexpr uint32_t FRESH = 0x4;
+
+  std::array<T, 3> slots{};
+  uint32_t back_index = 0;  // Producer
+  alignas(64) std::atomic<uint32_t> middle{1};
+  alignas(64) uint32_t front_index = 2; // Consumer
+};
@@ -0,0 +1,468 @@
+#include "thread_manager.h"
+#include "rt.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <tuple>
+
+ThreadManager::ParallelJob ThreadManager::job;
+
+namespace {
+int read_sysfs_int(const std::string &path, int fallback) {
+  std::ifstream file(path);
+  int value;
+  return (file >> value) ? value : fallback;
+}
+
+std::string read_sysfs_line(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+int numa_node_of(int cpu) {
+  namespace fs = std::filesystem;
+  std::error_code error;
+  const fs::path dir =
+      "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  for (const auto &entry : fs::directory_iterator(dir, error)) {
+    const std::string name = entry.path().filename().string();
+    if (name.rfind("node", 0) == 0) {
+      return std::atoi(name.c_str() + 4);
+    }
+  }
+  return 0;
+}
+} // namespace
+
+std::vector<int> ThreadManager::parse_cpu_list(const std::string &list) {
+  std::vector<int> cpus;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    int first = 0;
+    int last = 0;
+    const int fields = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (fields < 1 || first < 0) {
+      continue;
+    }
+    if (fields == 1) {
+      last = first;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+void ThreadManager::init(unsigned num_threads, const PlacementPolicy &policy) {
+  unsigned thread_count =
+      num_threads == 0 ? std::max(1u, std::thread::hardware_concurrency())
+                       : num_threads;
+
+  placement = policy;
+  if (placement.allowed_cpus.empty()) {
+    cpu_set_t process_cpus;
+    CPU_ZERO(&process_cpus);
+    if (sched_getaffinity(0, sizeof(process_cpus), &process_cpus) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &process_cpus)) {
+          placement.allowed_cpus.push_back(cpu);
+        }
+      }
+    }
+  }
+
+  topology.clear();
+  for (int cpu : placement.allowed_cpus) {
+    const std::string base =
+        "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+    const std::vector<int> siblings =
+        parse_cpu_list(read_sysfs_line(base + "thread_siblings_list"));
+    const auto position = std::find(siblings.begin(), siblings.end(), cpu);
+    topology.push_back(
+        {cpu, numa_node_of(cpu),
+         read_sysfs_int(base + "physical_package_id", 0),
+         siblings.empty() ? cpu : siblings.front(),
+         position == siblings.end()
+             ? 0
+             : static_cast<int>(position - siblings.begin())});
+  }
+
+  quit_flag.store(false);
+  workers.clear();
+  workers.reserve(thread_count);
+  // Create every worker before any thread starts so stealing can scan the
+  // whole pool
+  for (unsigned i = 0; i < thread_count; ++i) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+
+  unsigned started = 0;
+  while (started < thread_count && initialize_thread(started)) {
+    ++started;
+  }
+  if (started < thread_count) {
+    std::cerr << "Started " << started << " of " << thread_count
+              << " worker threads" << std::endl;
+    // The running workers may be scanning the pool, so rather than shrink
+    // it under them, rebuild it with as many workers as could start. No
+    // worker without a thread is ever placed or scheduled.
+    shutdown();
+    if (started > 0) {
+      init(started, policy);
+    }
+    return;
+  }
+  apply_placement();
+}
+
+bool ThreadManager::initialize_thread(unsigned index) {
+  try {
+    workers[index]->thread = std::thread(worker_thread, index);
+    return true;
+  } catch (const std::exception &e) {
+    std::cerr << "Exception in initializing thread: " << e.what() << std::endl;
+    return false;
+  }
+}
+
+// Allowed CPUs in the order workers should take them
+std::vector<int> ThreadManager::placement_order() {
+  const CpuInfo *avoided = nullptr;
+  for (const auto &info : topology) {
+    if (info.cpu == avoided_cpu) {
+      avoided = &info;
+    }
+  }
+
+  std::vector<CpuInfo> candidates;
+  for (const auto &info : topology) {
+    // Skip the JACK thread's physical core, including its SMT siblings
+    if (avoided && info.package == avoided->package &&
+        info.core == avoided->core) {
+      continue;
+    }
+    candidates.push_back(info);
+  }
+  if (candidates.empty()) {
+    candidates = topology;
+  }
+
+  // Stay on the JACK thread's NUMA node first, then spread over physical
+  // cores before doubling up on hardware threads
+  const int home_node = avoided ? avoided->node : -1;
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [home_node](const CpuInfo &a, const CpuInfo &b) {
+                     const int smt_a =
+                         placement.prefer_physical_cores ? a.smt_index : 0;
+                     const int smt_b =
+                         placement.prefer_physical_cores ? b.smt_index : 0;
+                     return std::make_tuple(smt_a, a.node != home_node, a.node,
+                                            a.package, a.core, a.cpu) <
+                            std::make_tuple(smt_b, b.node != home_node, b.node,
+                                            b.package, b.core, b.cpu);
+                   });
+
+  std::vector<int> order;
+  for (const auto &info : candidates) {
+    order.push_back(info.cpu);
+  }
+  return order;
+}
+
+void ThreadManager::apply_placement() {
+  const std::vector<int> order = placement_order();
+  if (order.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < workers.size(); ++i) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(order[i % order.size()], &cpuset);
+    workers[i]->pinned_cpu.store(order[i % order.size()],
+                                 std::memory_order_relaxed);
+    int rc = pthread_setaffinity_np(workers[i]->thread.native_handle(),
+                                    sizeof(cpu_set_t), &cpuset);
+    if (rc != 0) {
+      std::cerr << "Error calling pthread_setaffinity_np: " << rc << std::endl;
+    }
+  }
+}
+
+void ThreadManager::set_avoided_cpu(int cpu) {
+  if (cpu == avoided_cpu) {
+    return;
+  }
+  avoided_cpu = cpu;
+  apply_placement();
+}
+
+void ThreadManager::set_realtime_priority(int priority) {
+  sched_param param{};
+  param.sched_priority = priority;
+  const int policy = priority > 0 ? SCHED_FIFO : SCHED_OTHER;
+  worker_priority.store(priority, std::memory_order_relaxed);
+  for (auto &worker : workers) {
+    int rc = pthread_setschedparam(worker->thread.native_handle(), policy,
+                                   &param);
+    if (rc != 0) {
+      std::cerr << "Error calling pthread_setschedparam: " << std::strerror(rc)
+                << std::endl;
+      return;
+    }
+  }
+}
+
+void ThreadManager::release_current_worker() {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  for (int cpu : placement.allowed_cpus) {
+    CPU_SET(cpu, &cpuset);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+  sched_param param{};
+  pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+}
+
+// Reads the placement back rather than saving it in release, since the
+// control thread may have moved the worker in between
+void ThreadManager::restore_current_worker() {
+  const int cpu = workers[current_worker]->pinned_cpu.load(
+      std::memory_order_relaxed);
+  if (cpu >= 0) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+  }
+  sched_param param{};
+  param.sched_priority = worker_priority.load(std::memory_order_relaxed);
+  pthread_setschedparam(pthread_self(),
+                        param.sched_priority > 0 ? SCHED_FIFO : SCHED_OTHER,
+                        &param);
+}
+
+// Locks the part of the calling thread's stack nearest its base, which is
+// where the worker loop and its tasks run
+void ThreadManager::lock_current_stack() {
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+    return;
+  }
+  void *stack_addr = nullptr;
+  size_t stack_size = 0;
+  if (pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0) {
+    const size_t lock_size = std::min(stack_size, LOCKED_STACK_BYTES);
+    char *stack_top = static_cast<char *>(stack_addr) + stack_size;
+    if (mlock(stack_top - lock_size, lock_size) != 0) {
+      std::cerr << "Could not lock worker stack: " << std::strerror(errno)
+                << std::endl;
+    }
+  }
+  pthread_attr_destroy(&attr);
+}
+
+void ThreadManager::shutdown() {
+  quit_flag.store(true);
+  wake_workers();
+
+  for (auto &worker : workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+  workers.clear();
+}
+
+bool ThreadManager::submit(const Task &task) {
+  bool queued;
+  if (current_worker >= 0) {
+    queued = workers[current_worker]->deque.push(task) ||
+             injection_queue.try_push(task);
+  } else {
+    queued = injection_queue.try_push(task);
+  }
+  if (queued) {
+    wake_workers();
+  }
+  return queued;
+}
+
+void ThreadManager::run_task(const std::function<void()> &task) {
+  if (workers.empty()) {
+    task();
+    return;
+  }
+  // Running the boxed task inline, rather than the original, frees its copy
+  Task boxed = Task::boxed(task);
+  if (!submit(boxed)) {
+    boxed();
+  }
+}
+
+void ThreadManager::run_blocking_task(const std::function<void()> &task) {
+  run_task([task] {
+    const bool on_worker = current_worker >= 0;
+    if (on_worker) {
+      release_current_worker();
+    }
+    task();
+    if (on_worker) {
+      restore_current_worker();
+    }
+  });
+}
+
+void ThreadManager::wake_workers() {
+  wake_epoch.fetch_add(1, std::memory_order_release);
+  wake_epoch.notify_all();
+}
+
+std::vector<ThreadManager::WorkerStats> ThreadManager::worker_stats() {
+  std::vector<WorkerStats> stats;
+  stats.reserve(workers.size());
+  for (const auto &worker : workers) {
+    stats.push_back(
+        {worker->tasks_run.load(std::memory_order_relaxed),
+         worker->steals.load(std::memory_order_relaxed),
+         std::chrono::nanoseconds(
+             worker->idle_ns.load(std::memory_order_relaxed))});
+  }
+  return stats;
+}
+
+bool ThreadManager::try_parallel_for(unsigned count, ParallelFn fn,
+                                     void *context) {
+  if (count == 0) {
+    return true;
+  }
+  if (workers.empty() || job_busy.exchange(true, std::memory_order_acquire)) {
+    return false;
+  }
+
+  job.fn = fn;
+  job.context = context;
+  job.count = count;
+  job.next_index.store(0, std::memory_order_relaxed);
+  job.remaining.store(count, std::memory_order_relaxed);
+  job.generation.fetch_add(1, std::memory_order_relaxed);
+  job.open.store(true, std::memory_order_seq_cst);
+  wake_workers();
+
+  run_parallel_indices(0);
+  while (job.remaining.load(std::memory_order_acquire) != 0) {
+    rt::cpu_relax();
+  }
+
+  // Close the job and wait for stragglers that joined late to leave before
+  // the slot can be reused
+  job.open.store(false, std::memory_order_seq_cst);
+  while (job.joined.load(std::memory_order_seq_cst) != 0) {
+    rt::cpu_relax();
+  }
+  job_busy.store(false, std::memory_order_release);
+  return true;
+}
+
+void ThreadManager::run_parallel_indices(unsigned participant) {
+  unsigned index;
+  while ((index = job.next_index.fetch_add(1, std::memory_order_relaxed)) <
+         job.count) {
+    job.fn(job.context, index, participant);
+    job.remaining.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+bool ThreadManager::run_parallel_job(unsigned participant,
+                                     uint64_t &last_generation) {
+  if (!job.open.load(std::memory_order_acquire)) {
+    return false;
+  }
+  job.joined.fetch_add(1, std::memory_order_seq_cst);
+  const bool open = job.open.load(std::memory_order_seq_cst);
+  const uint64_t generation = job.generation.load(std::memory_order_relaxed);
+  const bool joined = open && generation != last_generation;
+  if (joined) {
+    last_generation = generation;
+    run_parallel_indices(participant);
+  }
+  job.joined.fetch_sub(1, std::memory_order_release);
+  return joined;
+}
+
+// Own deque first (LIFO, cache-warm), then external submissions, then the
+// other workers' deques starting from the next one along
+bool ThreadManager::find_task(unsigned index, Task &task) {
+  Worker &self = *workers[index];
+  if (self.deque.pop(task) || injection_queue.try_pop(task)) {
+    return true;
+  }
+  const size_t count = workers.size();
+  for (size_t offset = 1; offset < count; ++offset) {
+    if (workers[(index + offset) % count]->deque.steal(task)) {
+      self.steals.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadManager::worker_thread(unsigned index) {
+  current_worker = static_cast<int>(index);
+  // Workers run slices of the audio blocks, so they flush denormals as the
+  // process callback does
+  rt::DenormalGuard denormals;
+  if (placement.lock_stacks) {
+    lock_current_stack();
+  }
+  Worker &self = *workers[index];
+  const unsigned participant = index + 1;
+  uint64_t last_generation = 0;
+
+  while (true) {
+    // Read the epoch before looking for work so a wakeup between the checks
+    // and the wait is never lost
+    const uint32_t epoch = wake_epoch.load(std::memory_order_acquire);
+
+    if (run_parallel_job(participant, last_generation)) {
+      continue;
+    }
+
+    Task task;
+    if (find_task(index, task)) {
+      // Execute the task
+      task();
+      self.tasks_run.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    if (quit_flag.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    const auto idle_start = std::chrono::steady_clock::now();
+    int spins = 0;
+    while (wake_epoch.load(std::memory_order_acquire) == epoch &&
+           spins++ < SPIN_ITERATIONS) {
+      rt::cpu_relax();
+    }
+    wake_epoch.wait(epoch, std::memory_order_acquire);
+    self.idle_ns.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - idle_start)
+            .count(),
+        std::memory_order_relaxed);
+  }
+}
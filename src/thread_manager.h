@@ -0,0 +1,168 @@
+#pragma once
+
+#include "task_queue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Where ThreadManager places its workers
+struct PlacementPolicy {
+  // CPUs workers may run on; empty means the process affinity mask
+  std::vector<int> allowed_cpus;
+  // Fill every physical core before placing workers on SMT siblings
+  bool prefer_physical_cores = true;
+  // Lock the top of each worker's stack into RAM so the audio path never
+  // page-faults on it
+  bool lock_stacks = true;
+};
+
+// Thread Manager class
+//
+// Owns a pool of pinned worker threads running a work-stealing scheduler:
+// each worker has a Chase-Lev deque, and threads outside the pool submit
+// through a lock-free injection queue. Idle workers steal from each other,
+// then spin briefly and sleep on an atomic.
+//
+// try_submit and try_parallel_for never lock or allocate and may be called
+// from the audio thread. try_parallel_for is a fork/join in which the caller
+// takes part, for splitting one block of work across the pool.
+//
+// Workers are placed from the CPU topology: one per physical core before
+// any SMT sibling is used, grouped by NUMA node, and kept off the core the
+// JACK process thread runs on once that is known.
+class ThreadManager {
+public:
+  // fn(context, index, participant). The calling thread is participant 0 and
+  // worker i is participant i + 1.
+  using ParallelFn = void (*)(void *context, unsigned index,
+                              unsigned participant);
+
+  struct WorkerStats {
+    uint64_t tasks_run = 0;
+    uint64_t steals = 0;
+    std::chrono::nanoseconds idle_time{0};
+  };
+
+  static void init(unsigned num_threads, const PlacementPolicy &policy = {});
+  static void shutdown();
+
+  // Control thread only. Re-pins the workers away from the physical core of
+  // `cpu` (and its SMT siblings). Does nothing if cpu is unchanged.
+  static void set_avoided_cpu(int cpu);
+
+  // Control thread only. Moves the workers to SCHED_FIFO at the given
+  // priority, typically jack_client_real_time_priority(); 0 restores
+  // SCHED_OTHER.
+  static void set_realtime_priority(int priority);
+
+  // Parses a Linux cpulist such as "0-3,6"; invalid entries are skipped
+  static std::vector<int> parse_cpu_list(const std::string &list);
+
+  // Queues a small, trivially copyable callable (see Task). Real-time safe;
+  // returns false when the queues are full.
+  template <typename F> static bool try_submit(F &&fn) {
+    return submit(Task(std::forward<F>(fn)));
+  }
+
+  // Queues any callable. Large or non-trivial callables are boxed on the
+  // heap, and on a full queue the task runs on the calling thread, so this
+  // always succeeds but is not real-time safe.
+  static void run_task(const std::function<void()> &task);
+
+  // Queues a task that blocks on other processes or starts threads of its
+  // own, such as opening a JACK client. The worker runs it at SCHED_OTHER
+  // on every allowed CPU rather than pinned at the realtime priority, so
+  // threads it creates do not inherit the worker's placement, then goes
+  // back to its placement. Not real-time safe.
+  static void run_blocking_task(const std::function<void()> &task);
+
+  // Runs fn for every index in [0, count) on the caller and the workers and
+  // returns once all have completed. Returns false without running anything
+  // when another parallel job is in flight; the caller then runs serially.
+  static bool try_parallel_for(unsigned count, ParallelFn fn, void *context);
+
+  // Upper bound on participant indices passed to a ParallelFn
+  static unsigned num_participants() {
+    return static_cast<unsigned>(workers.size()) + 1;
+  }
+
+  // Snapshot of each worker's counters, indexed by worker
+  static std::vector<WorkerStats> worker_stats();
+
+private:
+  // Iterations a worker spins before sleeping, so back-to-back audio blocks
+  // find it awake
+  static constexpr int SPIN_ITERATIONS = 20000;
+
+  struct alignas(64) Worker {
+    std::thread thread;
+    WorkStealingDeque<Task, 256> deque;
+    std::atomic<uint64_t> tasks_run{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<int64_t> idle_ns{0};
+    // CPU apply_placement last pinned the worker to, or -1
+    std::atomic<int> pinned_cpu{-1};
+  };
+
+  // The single in-flight parallel job
+  struct ParallelJob {
+    ParallelFn fn = nullptr;
+    void *context = nullptr;
+    unsigned count = 0;
+    std::atomic<unsigned> next_index{0};
+    std::atomic<unsigned> remaining{0};
+    std::atomic<unsigned> joined{0}; // Workers currently inside the job
+    std::atomic<uint64_t> generation{0};
+    std::atomic<bool> open{false};
+  };
+
+  // One logical CPU and where it sits in the machine
+  struct CpuInfo {
+    int cpu;
+    int node;
+    int package;
+    int core;      // First logical CPU of the physical core
+    int smt_index; // Position among the core's hardware threads
+  };
+
+  static bool submit(const Task &task);
+  static void worker_thread(unsigned index);
+  static bool initialize_thread(unsigned index);
+  static std::vector<int> placement_order();
+  static void apply_placement();
+  static void lock_current_stack();
+  // Worker side of run_blocking_task
+  static void release_current_worker();
+  static void restore_current_worker();
+  static bool find_task(unsigned index, Task &task);
+  static bool run_parallel_job(unsigned participant,
+                               uint64_t &last_generation);
+  static void run_parallel_indices(unsigned participant);
+  static void wake_workers();
+
+  // Bytes of each worker stack locked by PlacementPolicy::lock_stacks
+  static constexpr size_t LOCKED_STACK_BYTES = 256 * 1024;
+
+  inline static std::vector<std::unique_ptr<Worker>> workers;
+  inline static PlacementPolicy placement;
+  inline static std::vector<CpuInfo> topology;
+  inline static int avoided_cpu = -1;
+  // Priority set by set_realtime_priority, for restore_current_worker
+  inline static std::atomic<int> worker_priority{0};
+  inline static MPMCQueue<Task, 1024> injection_queue;
+  inline static std::atomic<bool> quit_flag{false};
+  // Bumped whenever there is new work; idle workers wait on it
+  inline static std::atomic<uint32_t> wake_epoch{0};
+  // Index of the worker running on this thread, or -1 outside the pool
+  inline static thread_local int current_worker = -1;
+
+  inline static std::atomic<bool> job_busy{false};
+  static ParallelJob job;
+};
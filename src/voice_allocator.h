@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Note-to-voice assignment shared by the polyphonic DSPs. Audio thread only.
+//
+// A note takes the voice already playing it, then the lowest idle voice,
+// and otherwise steals one: voices that are already releasing go first, then
+// the policy decides among the rest. Allocating from the bottom keeps the
+// sounding voices packed together.
+class VoiceAllocator {
+public:
+  enum class StealPolicy { Oldest, Quietest };
+  enum class Stage { Idle, Active, Releasing };
+
+  struct Voice {
+    Stage stage = Stage::Idle;
+    int note = -1;
+    uint64_t started = 0;
+    float level = 0.0f; // Loudness estimate, kept up to date by the owner
+  };
+
+  explicit VoiceAllocator(size_t num_voices) : voices(num_voices) {}
+
+  // Returns the voice that should play the note, now marked active
+  unsigned allocate(int note, StealPolicy policy) {
+    const unsigned voice = choose(note, policy);
+    voices[voice].stage = Stage::Active;
+    voices[voice].note = note;
+    voices[voice].started = ++note_counter;
+    return voice;
+  }
+
+  // Moves every active voice playing the note to its release stage and calls
+  // fn(voice) for each
+  template <typename Fn> void release(int note, Fn &&fn) {
+    for (unsigned v = 0; v < voices.size(); ++v) {
+      if (voices[v].stage == Stage::Active && voices[v].note == note) {
+        voices[v].stage = Stage::Releasing;
+        fn(v);
+      }
+    }
+  }
+
+  // Call once a released voice has faded out
+  void finish(unsigned voice) {
+    voices[voice].stage = Stage::Idle;
+    voices[voice].note = -1;
+  }
+
+  bool is_idle(unsigned voice) const {
+    return voices[voice].stage == Stage::Idle;
+  }
+
+  Voice &operator[](size_t voice) { return voices[voice]; }
+  const Voice &operator[](size_t voice) const { return voices[voice]; }
+  size_t size() const { return voices.size(); }
+
+private:
+  unsigned choose(int note, StealPolicy policy) const {
+    for (unsigned v = 0; v < voices.size(); ++v) {
+      if (voices[v].stage != Stage::Idle && voices[v].note == note) {
+        return v; // Retrigger
+      }
+    }
+    for (unsigned v = 0; v < voices.size(); ++v) {
+      if (voices[v].stage == Stage::Idle) {
+        return v;
+      }
+    }
+
+    unsigned victim = 0;
+    for (unsigned v = 1; v < voices.size(); ++v) {
+      const Voice &a = voices[v];
+      const Voice &b = voices[victim];
+      const bool a_releasing = a.stage == Stage::Releasing;
+      const bool b_releasing = b.stage == Stage::Releasing;
+      if (a_releasing != b_releasing) {
+        if (a_releasing) {
+          victim = v;
+        }
+        continue;
+      }
+      const bool better = policy == StealPolicy::Oldest ? a.started < b.started
+                                                        : a.level < b.level;
+      if (better) {
+        victim = v;
+      }
+    }
+    return victim;
+  }
+
+  std::vector<Voice> voices;
+  uint64_t note_counter = 0;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Mip-mapped, band-limited single-cycle wavetables.
+//
+// Level k holds the waveform's Fourier series truncated to
+// MAX_HARMONICS >> k harmonics, so each level covers one octave of playback
+// frequencies. Every harmonic of the selected level stays below Nyquist, so
+// there is no aliasing and no oversampling needed. Table sets are immutable
+// once built and are shared by every oscillator using the waveform.
+class WavetableSet {
+public:
+  static constexpr size_t TABLE_SIZE = 2048;
+  static constexpr size_t MAX_HARMONICS = TABLE_SIZE / 2;
+  static constexpr size_t NUM_LEVELS = 11; // 1024 harmonics down to 1
+
+  // Builds a table set from the sine-series amplitude of each harmonic,
+  // harmonic_amplitude(h) for h >= 1
+  template <typename HarmonicAmplitude>
+  static std::shared_ptr<const WavetableSet>
+  create(HarmonicAmplitude harmonic_amplitude) {
+    auto set = std::shared_ptr<WavetableSet>(new WavetableSet());
+
+    // sin(2 * pi * h * j / N) is sine_table[(h * j) % N] for integer h, j
+    std::vector<double> sine_table(TABLE_SIZE);
+    for (size_t j = 0; j < TABLE_SIZE; ++j) {
+      sine_table[j] = std::sin(2.0 * M_PI * static_cast<double>(j) /
+                               static_cast<double>(TABLE_SIZE));
+    }
+
+    std::vector<double> accumulator(TABLE_SIZE);
+    for (size_t level = 0; level < NUM_LEVELS; ++level) {
+      const size_t harmonics = MAX_HARMONICS >> level;
+      std::fill(accumulator.begin(), accumulator.end(), 0.0);
+      for (size_t h = 1; h <= harmonics; ++h) {
+        const double amplitude = harmonic_amplitude(static_cast<int>(h));
+        if (amplitude == 0.0) {
+          continue;
+        }
+        for (size_t j = 0; j < TABLE_SIZE; ++j) {
+          accumulator[j] += amplitude * sine_table[(h * j) % TABLE_SIZE];
+        }
+      }
+
+      float *table = set->tables.data() + level * STRIDE;
+      for (size_t j = 0; j < TABLE_SIZE; ++j) {
+        table[j] = static_cast<float>(accumulator[j]);
+      }
+      // Guard samples so interpolation never has to wrap
+      table[TABLE_SIZE] = table[0];
+      table[TABLE_SIZE + 1] = table[1];
+    }
+    return set;
+  }
+
+  // Band-limited counterparts of the naive SquareWave and SawWave
+  static std::shared_ptr<const WavetableSet> square() {
+    static const auto tables = create([](int h) {
+      return h % 2 == 1 ? 4.0 / (M_PI * h) : 0.0;
+    });
+    return tables;
+  }
+
+  static std::shared_ptr<const WavetableSet> saw() {
+    static const auto tables = create([](int h) {
+      return (h % 2 == 1 ? 2.0 : -2.0) / (M_PI * h);
+    });
+    return tables;
+  }
+
+  // Highest-resolution table whose harmonics all stay below Nyquist at the
+  // given phase increment (cycles per sample)
+  const float *table_for(double phase_increment) const {
+    const double span = std::abs(phase_increment) * 2.0 * MAX_HARMONICS;
+    size_t level = 0;
+    if (span > 1.0) {
+      level = std::min(static_cast<size_t>(std::ceil(std::log2(span))),
+                       NUM_LEVELS - 1);
+    }
+    return tables.data() + level * STRIDE;
+  }
+
+  // Linearly interpolated lookup at phase (in cycles, any range)
+  template <typename V> static V lookup(const float *table, V phase) {
+    const V x = phase - simd::floor(phase);
+    const V position = x * V(static_cast<float>(TABLE_SIZE));
+    const V index = simd::floor(position);
+    const V fraction = position - index;
+    const V a = simd::gather(table, index);
+    const V b = simd::gather(table + 1, index);
+    return simd::mul_add(fraction, b - a, a);
+  }
+
+private:
+  static constexpr size_t STRIDE = TABLE_SIZE + 2;
+
+  WavetableSet() : tables(NUM_LEVELS * STRIDE) {}
+
+  std::vector<float> tables;
+};